@@ -15,21 +15,66 @@
 
 #include "common_ringbuffer.h"
 
+#if CRB_FD_IO
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+
 #define _er_malloc MALLOC
 #define _er_free   FREE
 
 #define crb_fix(ptr, size)	((ptr)%(size))
 
+/*
+ * 单生产者单消费者模式: 写方只改write,读方只改read。
+ * 读取对方的指针后加acquire屏障,保证随后访问的数据不早于指针;
+ * 更新自己的指针前加release屏障,保证数据拷贝(或解析)已经完成。
+ */
+#if CRB_USE_SPSC
+#include <stdatomic.h>
+#define crb_smp_rmb()			atomic_thread_fence(memory_order_acquire)
+#define crb_smp_wmb()			atomic_thread_fence(memory_order_release)
+#define CRB_READ_ONCE(x)		(*(volatile typeof(x) *)&(x))
+#define CRB_WRITE_ONCE(x, v)	(*(volatile typeof(x) *)&(x) = (v))
+#else
+#define crb_smp_rmb()
+#define crb_smp_wmb()
+#define CRB_READ_ONCE(x)		(x)
+#define CRB_WRITE_ONCE(x, v)	((x) = (v))
+#endif
+
+/*
+ * 2的幂模式下read/write自由递增,溢出回绕后相减依然正确,
+ * 只在访问内存时用mask取下标,也不需要空出一个字节区分空满
+ */
+static inline bool crb_is_pow2(Crb *fifo)
+{
+	return fifo->mask != 0;
+}
+
+static inline uint32_t crb_index(Crb *fifo, uint32_t ptr)
+{
+	return crb_is_pow2(fifo) ? ptr & fifo->mask : ptr;
+}
+
+static inline uint32_t crb_advance(Crb *fifo, uint32_t ptr, uint32_t n)
+{
+	return crb_is_pow2(fifo) ? ptr + n : crb_fix(ptr + n, fifo->mem_size);
+}
+
 static inline bool crb_full(Crb *fifo)
 {
-	if(crb_fix(fifo->write+1, fifo->mem_size) == fifo->read)
+	uint32_t read = CRB_READ_ONCE(fifo->read);
+	if(crb_is_pow2(fifo))
+		return fifo->write - read == fifo->mem_size;
+	if(crb_fix(fifo->write+1, fifo->mem_size) == read)
 		return true;
 	return false;
 }
 
 static inline bool crb_empty(Crb *fifo)
 {
-	if(fifo->write == fifo->read)
+	if(CRB_READ_ONCE(fifo->write) == CRB_READ_ONCE(fifo->read))
 		return true;
 	return false;
 }
@@ -41,8 +86,11 @@ static inline bool crb_empty(Crb *fifo)
  */
 uint32_t crb_Size(Crb *fifo)
 {
-	uint32_t write = fifo->write;
-	uint32_t read = fifo->read;
+	uint32_t write = CRB_READ_ONCE(fifo->write);
+	uint32_t read = CRB_READ_ONCE(fifo->read);
+	crb_smp_rmb();
+	if(crb_is_pow2(fifo))
+		return write - read;
 	write = read > write ? write + fifo->mem_size : write;
 	return write - read;
 }
@@ -54,6 +102,8 @@ uint32_t crb_Size(Crb *fifo)
  */
 uint32_t crb_FreeSize(Crb* fifo)
 {
+	if(crb_is_pow2(fifo))
+		return fifo->mem_size - crb_Size(fifo);
 	return fifo->mem_size - crb_Size(fifo) - 1;
 }
 
@@ -63,7 +113,9 @@ uint32_t crb_FreeSize(Crb* fifo)
  */
 void crb_Clear(Crb* fifo)
 {
-	fifo->read = fifo->write;
+	uint32_t write = CRB_READ_ONCE(fifo->write);
+	crb_smp_wmb();
+	CRB_WRITE_ONCE(fifo->read, write);
 }
 
 /**
@@ -77,7 +129,8 @@ uint32_t crb_ReadAir(Crb* fifo, uint32_t buf_size)
 	uint32_t br=0;
 	br = crb_Size(fifo);
 	br = br > buf_size ? buf_size : br ;
-	fifo->read = crb_fix(fifo->read + br, fifo->mem_size);
+	crb_smp_wmb();
+	CRB_WRITE_ONCE(fifo->read, crb_advance(fifo, fifo->read, br));
 	return br;
 }
 
@@ -92,6 +145,7 @@ uint32_t crb_Write(Crb* fifo,const uint8_t *buf, uint32_t buf_size)
 {
 	uint32_t wr = 0;
 	uint32_t wr_first=0;
+	uint32_t write;
 
 	if(buf == NULL || buf_size == 0) return 0;
 	if(crb_full(fifo))	return 0;
@@ -99,12 +153,14 @@ uint32_t crb_Write(Crb* fifo,const uint8_t *buf, uint32_t buf_size)
 	wr = crb_FreeSize(fifo);
 	if(wr == 0) return 0;
 	wr = wr > buf_size ? buf_size : wr;
-	wr_first = wr > fifo->mem_size-fifo->write ? fifo->mem_size-fifo->write : wr;
-	memcpy(fifo->mem+fifo->write, buf, wr_first);
+	write = crb_index(fifo, fifo->write);
+	wr_first = wr > fifo->mem_size-write ? fifo->mem_size-write : wr;
+	memcpy(fifo->mem+write, buf, wr_first);
 	if(wr-wr_first)
 		memcpy(fifo->mem+0, buf+wr_first, wr-wr_first);
 	/* 移动 */
-	fifo->write = crb_fix(fifo->write + wr, fifo->mem_size);
+	crb_smp_wmb();
+	CRB_WRITE_ONCE(fifo->write, crb_advance(fifo, fifo->write, wr));
 	return wr;
 }
 
@@ -120,17 +176,20 @@ uint32_t crb_Read(Crb* fifo, uint8_t *buf, uint32_t buf_size)
 {
 	uint32_t br=0;
 	uint32_t br_first=0;
+	uint32_t read;
 	/* 为空 */
 	if(crb_empty(fifo)) return 0;
 	
 	br = crb_Size(fifo);
 	br = br > buf_size ? buf_size : br ;
-	br_first = br > fifo->mem_size-fifo->read ? fifo->mem_size-fifo->read : br;
-	memcpy(buf, fifo->mem+fifo->read, br_first);
+	read = crb_index(fifo, fifo->read);
+	br_first = br > fifo->mem_size-read ? fifo->mem_size-read : br;
+	memcpy(buf, fifo->mem+read, br_first);
 	if(br-br_first)
 		memcpy(buf+br_first, fifo->mem+0, br-br_first);
 	/* 移动 */
-	fifo->read = crb_fix(fifo->read + br, fifo->mem_size);
+	crb_smp_wmb();
+	CRB_WRITE_ONCE(fifo->read, crb_advance(fifo, fifo->read, br));
 	return br;
 }
 
@@ -145,19 +204,216 @@ uint32_t crb_Peep(Crb* fifo, uint8_t *buf, uint32_t buf_size)
 {
 	uint32_t br=0;
 	uint32_t br_first=0;
+	uint32_t read;
 	/* 为空 */
 	if(crb_empty(fifo)) return 0;
 	
 	br = crb_Size(fifo);
 	br = br > buf_size ? buf_size : br ;
-	br_first = br > fifo->mem_size-fifo->read ? fifo->mem_size-fifo->read : br;
-	memcpy(buf, fifo->mem+fifo->read, br_first);
+	read = crb_index(fifo, fifo->read);
+	br_first = br > fifo->mem_size-read ? fifo->mem_size-read : br;
+	memcpy(buf, fifo->mem+read, br_first);
 	if(br-br_first)
 		memcpy(buf+br_first, fifo->mem+0, br-br_first);
 	return br;
 }
 
 
+/*
+ * 查找时把[read+start, write)描述为最多两段连续内存,直接在缓冲区上搜索
+ */
+typedef struct _CrbSpan{
+	const uint8_t 	*p[2];
+	uint32_t 		l[2];
+}CrbSpan;
+
+static uint32_t crb_span(Crb *fifo, uint32_t start, CrbSpan *sp)
+{
+	uint32_t size = crb_Size(fifo);
+	uint32_t pos;
+	if(start >= size)
+		return 0;
+	size -= start;
+	pos = crb_index(fifo, crb_advance(fifo, fifo->read, start));
+	sp->p[0] = fifo->mem + pos;
+	sp->l[0] = size > fifo->mem_size - pos ? fifo->mem_size - pos : size;
+	sp->p[1] = fifo->mem;
+	sp->l[1] = size - sp->l[0];
+	return size;
+}
+
+/* 从span内偏移from开始查找字节c,返回span内偏移,未找到返回-1 */
+static er_ssize_t crb_span_chr(const CrbSpan *sp, uint32_t from, uint8_t c)
+{
+	const uint8_t *q;
+	if(from < sp->l[0])
+	{
+		q = memchr(sp->p[0] + from, c, sp->l[0] - from);
+		if(q)
+			return q - sp->p[0];
+		from = sp->l[0];
+	}
+	q = memchr(sp->p[1] + (from - sp->l[0]), c, sp->l[1] - (from - sp->l[0]));
+	if(q)
+		return sp->l[0] + (q - sp->p[1]);
+	return -1;
+}
+
+/* span内偏移pos处是否为seq,调用者保证pos+seq_len不越界 */
+static bool crb_span_equal(const CrbSpan *sp, uint32_t pos, const uint8_t *seq, uint32_t seq_len)
+{
+	uint32_t first;
+	if(pos >= sp->l[0])
+		return memcmp(sp->p[1] + (pos - sp->l[0]), seq, seq_len) == 0;
+	first = sp->l[0] - pos > seq_len ? seq_len : sp->l[0] - pos;
+	return memcmp(sp->p[0] + pos, seq, first) == 0 &&
+		memcmp(sp->p[1], seq + first, seq_len - first) == 0;
+}
+
+/**
+ * @brief  在缓冲区数据中查找一个字节，跨越环回点时也不需要拷贝
+ * @param  fifo             句柄
+ * @param  start            从距离读指针start个字节处开始查找
+ * @param  byte             要查找的字节
+ * @return er_ssize_t 		返回相对读指针的偏移，未找到返回-1
+ */
+er_ssize_t crb_FindByte(Crb* fifo, uint32_t start, uint8_t byte)
+{
+	CrbSpan sp;
+	er_ssize_t pos;
+	if(crb_span(fifo, start, &sp) == 0)
+		return -1;
+	pos = crb_span_chr(&sp, 0, byte);
+	return pos < 0 ? -1 : (er_ssize_t)start + pos;
+}
+
+/**
+ * @brief  在缓冲区数据中查找一段字节序列
+ * @param  fifo             句柄
+ * @param  start            从距离读指针start个字节处开始查找
+ * @param  seq              要查找的字节序列
+ * @param  seq_len          字节序列的长度
+ * @return er_ssize_t 		返回序列首字节相对读指针的偏移，未找到返回-1
+ */
+er_ssize_t crb_FindSeq(Crb* fifo, uint32_t start, const uint8_t *seq, uint32_t seq_len)
+{
+	CrbSpan sp;
+	uint32_t size;
+	er_ssize_t pos = 0;
+	if(seq == NULL || seq_len == 0)
+		return -1;
+	size = crb_span(fifo, start, &sp);
+	while(size >= seq_len)
+	{
+		/* 先用memchr找首字节,再比较剩余部分 */
+		pos = crb_span_chr(&sp, pos, seq[0]);
+		if(pos < 0 || (uint32_t)pos > size - seq_len)
+			return -1;
+		if(crb_span_equal(&sp, pos, seq, seq_len))
+			return (er_ssize_t)start + pos;
+		pos++;
+	}
+	return -1;
+}
+
+/**
+ * @brief  在缓冲区数据中查找第一个属于集合set的字节
+ * @param  fifo             句柄
+ * @param  start            从距离读指针start个字节处开始查找
+ * @param  set              字节集合
+ * @param  set_len          集合中字节的个数
+ * @return er_ssize_t 		返回相对读指针的偏移，未找到返回-1
+ */
+er_ssize_t crb_FindAny(Crb* fifo, uint32_t start, const uint8_t *set, uint32_t set_len)
+{
+	CrbSpan sp;
+	uint32_t map[8] = {0};
+	uint32_t i, j, off = 0;
+	if(set == NULL || set_len == 0)
+		return -1;
+	if(set_len == 1)
+		return crb_FindByte(fifo, start, set[0]);
+	if(crb_span(fifo, start, &sp) == 0)
+		return -1;
+	for(i = 0; i < set_len; i++)
+		map[set[i] >> 5] |= 1u << (set[i] & 31);
+	for(j = 0; j < 2; off += sp.l[j], j++)
+	{
+		for(i = 0; i < sp.l[j]; i++)
+		{
+			if(map[sp.p[j][i] >> 5] & (1u << (sp.p[j][i] & 31)))
+				return (er_ssize_t)(start + off + i);
+		}
+	}
+	return -1;
+}
+#if CRB_FD_IO
+/**
+ * @brief  从文件描述符读数据直接写入环形缓冲区，空闲空间的两段用readv一次填充
+ * @param  fifo             句柄
+ * @param  fd               文件描述符
+ * @param  max_size         最多读取的字节数
+ * @return er_ssize_t 		返回读到的字节数，文件结束或缓冲区满返回0，出错返回-1(errno有效)
+ */
+er_ssize_t crb_ReadFromFd(Crb* fifo, int fd, uint32_t max_size)
+{
+	struct iovec iov[2];
+	uint32_t wr = 0;
+	uint32_t wr_first=0;
+	uint32_t write;
+	ssize_t rn;
+
+	wr = crb_FreeSize(fifo);
+	wr = wr > max_size ? max_size : wr;
+	if(wr == 0) return 0;
+	write = crb_index(fifo, fifo->write);
+	wr_first = wr > fifo->mem_size-write ? fifo->mem_size-write : wr;
+	iov[0].iov_base = fifo->mem+write;
+	iov[0].iov_len  = wr_first;
+	iov[1].iov_base = fifo->mem+0;
+	iov[1].iov_len  = wr-wr_first;
+	rn = readv(fd, iov, wr-wr_first ? 2 : 1);
+	if(rn <= 0)
+		return rn < 0 ? -1 : 0;
+	/* 移动 */
+	crb_smp_wmb();
+	CRB_WRITE_ONCE(fifo->write, crb_advance(fifo, fifo->write, (uint32_t)rn));
+	return (er_ssize_t)rn;
+}
+
+/**
+ * @brief  把环形缓冲区的数据直接写入文件描述符，已用空间的两段用writev一次写出
+ * @param  fifo             句柄
+ * @param  fd               文件描述符
+ * @param  max_size         最多写出的字节数
+ * @return er_ssize_t 		返回写出的字节数，出错返回-1(errno有效)
+ */
+er_ssize_t crb_WriteToFd(Crb* fifo, int fd, uint32_t max_size)
+{
+	struct iovec iov[2];
+	uint32_t br=0;
+	uint32_t br_first=0;
+	uint32_t read;
+	ssize_t wn;
+
+	br = crb_Size(fifo);
+	br = br > max_size ? max_size : br ;
+	if(br == 0) return 0;
+	read = crb_index(fifo, fifo->read);
+	br_first = br > fifo->mem_size-read ? fifo->mem_size-read : br;
+	iov[0].iov_base = fifo->mem+read;
+	iov[0].iov_len  = br_first;
+	iov[1].iov_base = fifo->mem+0;
+	iov[1].iov_len  = br-br_first;
+	wn = writev(fd, iov, br-br_first ? 2 : 1);
+	if(wn <= 0)
+		return wn < 0 ? -1 : 0;
+	/* 移动 */
+	crb_smp_wmb();
+	CRB_WRITE_ONCE(fifo->read, crb_advance(fifo, fifo->read, (uint32_t)wn));
+	return (er_ssize_t)wn;
+}
+#endif
 
 /**
  * @brief 新建一个环形缓冲区
@@ -173,6 +429,7 @@ Crb* crb_New(uint32_t size)
 	crb_new->mem 	  	= (uint8_t *)(crb_new+1);	
 	crb_new->mem_size 	= size;
 	crb_new->read 		= crb_new->write = 0;
+	crb_new->mask 		= 0;
 	crb_new->is_static  = 0;
 	return crb_new;
 }
@@ -190,6 +447,46 @@ int crb_StaticNew(Crb* crb, uint8_t* buf, uint32_t size){
 	crb->mem 	  	= buf;
 	crb->mem_size 	= size;
 	crb->read 		= crb->write = 0;
+	crb->mask 		= 0;
+	crb->is_static  = 1;
+	return 0;
+}
+
+/**
+ * @brief 新建一个2的幂模式的环形缓冲区，size个字节全部可用，读写不再做取模运算
+ * @param  size             环形缓冲区的容量，必须是2的幂
+ * @return Crb* 			返回一个实例，size不合法时返回NULL
+ */
+Crb* crb_NewPow2(uint32_t size)
+{
+	Crb *crb_new;
+	if(size < 2 || (size & (size - 1)))
+		return NULL;
+	crb_new = (Crb *)_er_malloc(sizeof(Crb)+size);
+	if( crb_new == NULL )
+		return NULL;
+	crb_new->mem 	  	= (uint8_t *)(crb_new+1);
+	crb_new->mem_size 	= size;
+	crb_new->read 		= crb_new->write = 0;
+	crb_new->mask 		= size - 1;
+	crb_new->is_static  = 0;
+	return crb_new;
+}
+
+/**
+ * @brief 使用静态的方式创建2的幂模式的crb
+ * @param  crb             	外部实例化
+ * @param  buf              静态缓冲区（生命周期长的栈上缓冲区）
+ * @param  size             缓冲区大小，必须是2的幂
+ * @return int 
+ */
+int crb_StaticNewPow2(Crb* crb, uint8_t* buf, uint32_t size){
+	if(buf == NULL || crb == NULL || size < 2 || (size & (size - 1)))
+		return -1;
+	crb->mem 	  	= buf;
+	crb->mem_size 	= size;
+	crb->read 		= crb->write = 0;
+	crb->mask 		= size - 1;
 	crb->is_static  = 1;
 	return 0;
 }
@@ -11,28 +11,61 @@
  * 
  * @par 修改日志:
  */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE		/* memfd_create */
+#endif
 #include <string.h>
 
 #include "typedef.h"
 
 #include "elastic_ringbuffer.h"
 
+#if ERB_USE_MMAP_MIRROR && defined(__linux__)
+#include <unistd.h>
+#include <sys/mman.h>
+#define ERB_MIRROR	1
+#else
+#define ERB_MIRROR	0
+#endif
+
+#if ERB_FD_IO
+#include <unistd.h>
+#endif
+
 #define _er_malloc MALLOC
 #define _er_free   FREE
 
 
 #define erb_fix(ptr, size)	((ptr)%(size))
 
+/*
+ * 单生产者单消费者模式: 写方只改write,读方只改read。
+ * 读取对方的指针后加acquire屏障,保证随后访问的数据不早于指针;
+ * 更新自己的指针前加release屏障,保证数据拷贝(或解析)已经完成。
+ */
+#if ERB_USE_SPSC
+#include <stdatomic.h>
+#define erb_smp_rmb()			atomic_thread_fence(memory_order_acquire)
+#define erb_smp_wmb()			atomic_thread_fence(memory_order_release)
+#define ERB_READ_ONCE(x)		(*(volatile typeof(x) *)&(x))
+#define ERB_WRITE_ONCE(x, v)	(*(volatile typeof(x) *)&(x) = (v))
+#else
+#define erb_smp_rmb()
+#define erb_smp_wmb()
+#define ERB_READ_ONCE(x)		(x)
+#define ERB_WRITE_ONCE(x, v)	((x) = (v))
+#endif
+
 static inline bool erb_full(Erb *fifo)
 {
-	if(erb_fix(fifo->write+1, fifo->mem_size) == fifo->read)
+	if(erb_fix(fifo->write+1, fifo->mem_size) == ERB_READ_ONCE(fifo->read))
 		return true;
 	return false;
 }
 
 static inline bool erb_empty(Erb *fifo)
 {
-	if(fifo->write == fifo->read)
+	if(ERB_READ_ONCE(fifo->write) == ERB_READ_ONCE(fifo->read))
 		return true;
 	return false;
 }
@@ -44,8 +77,9 @@ static inline bool erb_empty(Erb *fifo)
  */
 uint32_t erb_Size(Erb *fifo)
 {
-	uint32_t write = fifo->write;
-	uint32_t read = fifo->read;
+	uint32_t write = ERB_READ_ONCE(fifo->write);
+	uint32_t read = ERB_READ_ONCE(fifo->read);
+	erb_smp_rmb();
 	write = read > write ? write + fifo->mem_size : write;
 	return write - read;
 }
@@ -73,7 +107,8 @@ uint32_t erb_ReadAir(Erb* fifo, uint32_t buf_size)
 	uint32_t br=0;
 	br = erb_Size(fifo);
 	br = br > buf_size ? buf_size : br ;
-	fifo->read = erb_fix(fifo->read + br, fifo->mem_size);
+	erb_smp_wmb();
+	ERB_WRITE_ONCE(fifo->read, erb_fix(fifo->read + br, fifo->mem_size));
 	return br;
 }
 
@@ -83,7 +118,9 @@ uint32_t erb_ReadAir(Erb* fifo, uint32_t buf_size)
  */
 void erb_Clear(Erb* fifo)
 {
-	fifo->read = fifo->write;
+	uint32_t write = ERB_READ_ONCE(fifo->write);
+	erb_smp_wmb();
+	ERB_WRITE_ONCE(fifo->read, write);
 }
 
 /**
@@ -118,6 +155,81 @@ const uint8_t* erb_PeepAll(Erb* fifo, uint32_t* peep_size)
 	return fifo->mem+fifo->read;
 }
 
+/**
+ * @brief  在缓冲区数据中查找一个字节，数据本就连续，直接memchr
+ * @param  fifo             句柄
+ * @param  start            从距离读指针start个字节处开始查找
+ * @param  byte             要查找的字节
+ * @return er_ssize_t 		返回相对读指针的偏移，未找到返回-1
+ */
+er_ssize_t erb_FindByte(Erb* fifo, uint32_t start, uint8_t byte)
+{
+	uint32_t size;
+	const uint8_t *p = erb_PeepAll(fifo, &size);
+	const uint8_t *q;
+	if(start >= size)
+		return -1;
+	q = memchr(p + start, byte, size - start);
+	return q ? (er_ssize_t)(q - p) : -1;
+}
+
+/**
+ * @brief  在缓冲区数据中查找一段字节序列
+ * @param  fifo             句柄
+ * @param  start            从距离读指针start个字节处开始查找
+ * @param  seq              要查找的字节序列
+ * @param  seq_len          字节序列的长度
+ * @return er_ssize_t 		返回序列首字节相对读指针的偏移，未找到返回-1
+ */
+er_ssize_t erb_FindSeq(Erb* fifo, uint32_t start, const uint8_t *seq, uint32_t seq_len)
+{
+	uint32_t size;
+	const uint8_t *p = erb_PeepAll(fifo, &size);
+	const uint8_t *q;
+	if(seq == NULL || seq_len == 0 || start >= size)
+		return -1;
+	/* 先用memchr找首字节,再比较剩余部分 */
+	while(size - start >= seq_len)
+	{
+		q = memchr(p + start, seq[0], size - start - seq_len + 1);
+		if(q == NULL)
+			return -1;
+		if(memcmp(q + 1, seq + 1, seq_len - 1) == 0)
+			return (er_ssize_t)(q - p);
+		start = (uint32_t)(q - p) + 1;
+	}
+	return -1;
+}
+
+/**
+ * @brief  在缓冲区数据中查找第一个属于集合set的字节
+ * @param  fifo             句柄
+ * @param  start            从距离读指针start个字节处开始查找
+ * @param  set              字节集合
+ * @param  set_len          集合中字节的个数
+ * @return er_ssize_t 		返回相对读指针的偏移，未找到返回-1
+ */
+er_ssize_t erb_FindAny(Erb* fifo, uint32_t start, const uint8_t *set, uint32_t set_len)
+{
+	uint32_t size;
+	const uint8_t *p;
+	uint32_t map[8] = {0};
+	uint32_t i;
+	if(set == NULL || set_len == 0)
+		return -1;
+	if(set_len == 1)
+		return erb_FindByte(fifo, start, set[0]);
+	p = erb_PeepAll(fifo, &size);
+	for(i = 0; i < set_len; i++)
+		map[set[i] >> 5] |= 1u << (set[i] & 31);
+	for(i = start; i < size; i++)
+	{
+		if(map[p[i] >> 5] & (1u << (p[i] & 31)))
+			return (er_ssize_t)i;
+	}
+	return -1;
+}
+
 /**
  * @brief  读缓冲区的数据,放入buf缓冲区中
  * @param  fifo             句柄
@@ -135,10 +247,27 @@ uint32_t erb_Read(Erb* fifo, uint8_t *buf, uint32_t buf_size)
 	br = br > buf_size ? buf_size : br ;
 	memcpy(buf, fifo->mem+fifo->read, br);
 	/* 移动 */
-	fifo->read = erb_fix(fifo->read + br, fifo->mem_size);
+	erb_smp_wmb();
+	ERB_WRITE_ONCE(fifo->read, erb_fix(fifo->read + br, fifo->mem_size));
 	return br;
 }
 
+/**
+ * @brief 数据已写入mem+write之后的wr个字节,进行环回,保持后续观看时数据连续
+ * @param  fifo             句柄
+ * @param  wr               写入的字节数
+ */
+static void erb_Wrap(Erb* fifo, uint32_t wr)
+{
+	/* 双重映射时镜像由MMU维护,无需再拷贝 */
+	if(fifo->is_mirror)
+		return;
+	if(fifo->write + wr > (uint32_t)fifo->mem_size)
+		memcpy(fifo->mem, fifo->mem_tmp, (fifo->write + wr) - fifo->mem_size);
+	else
+		memcpy(fifo->mem_tmp + fifo->write, fifo->mem + fifo->write, wr);
+}
+
 /**
  * @brief 写环形缓冲区
  * @param  fifo             句柄
@@ -158,24 +287,148 @@ uint32_t erb_Write(Erb* fifo, uint8_t *buf, uint32_t buf_size)
 	wr = wr > buf_size ? buf_size : wr;
 	memcpy(fifo->mem+fifo->write, buf, wr);
 
-	/* 进行环回 */
-	if(fifo->write + wr > (uint32_t)fifo->mem_size)
-		memcpy(fifo->mem, fifo->mem_tmp, (fifo->write + wr) - fifo->mem_size);
-	else
-		memcpy(fifo->mem_tmp + fifo->write, buf, wr);
+	erb_Wrap(fifo, wr);
 	/* 移动 */
-	fifo->write = erb_fix(fifo->write + wr, fifo->mem_size);
+	erb_smp_wmb();
+	ERB_WRITE_ONCE(fifo->write, erb_fix(fifo->write + wr, fifo->mem_size));
 	return wr;
 }
 
+#if ERB_FD_IO
 /**
- * @brief 新建一个环形缓冲区
+ * @brief  从文件描述符读数据直接写入环形缓冲区，
+ * 			空闲空间在两倍大小的内存上本就连续，一次read即可
+ * @param  fifo             句柄
+ * @param  fd               文件描述符
+ * @param  max_size         最多读取的字节数
+ * @return er_ssize_t 		返回读到的字节数，文件结束或缓冲区满返回0，出错返回-1(errno有效)
+ */
+er_ssize_t erb_ReadFromFd(Erb* fifo, int fd, uint32_t max_size)
+{
+	uint32_t wr = 0;
+	ssize_t rn;
+
+	wr = erb_FreeSize(fifo);
+	wr = wr > max_size ? max_size : wr;
+	if(wr == 0) return 0;
+	rn = read(fd, fifo->mem+fifo->write, wr);
+	if(rn <= 0)
+		return rn < 0 ? -1 : 0;
+
+	erb_Wrap(fifo, (uint32_t)rn);
+	/* 移动 */
+	erb_smp_wmb();
+	ERB_WRITE_ONCE(fifo->write, erb_fix(fifo->write + (uint32_t)rn, fifo->mem_size));
+	return (er_ssize_t)rn;
+}
+
+/**
+ * @brief  把环形缓冲区的数据直接写入文件描述符，已用数据本就连续，一次write即可
+ * @param  fifo             句柄
+ * @param  fd               文件描述符
+ * @param  max_size         最多写出的字节数
+ * @return er_ssize_t 		返回写出的字节数，出错返回-1(errno有效)
+ */
+er_ssize_t erb_WriteToFd(Erb* fifo, int fd, uint32_t max_size)
+{
+	uint32_t br=0;
+	ssize_t wn;
+
+	br = erb_Size(fifo);
+	br = br > max_size ? max_size : br ;
+	if(br == 0) return 0;
+	wn = write(fd, fifo->mem+fifo->read, br);
+	if(wn <= 0)
+		return wn < 0 ? -1 : 0;
+	/* 移动 */
+	erb_smp_wmb();
+	ERB_WRITE_ONCE(fifo->read, erb_fix(fifo->read + (uint32_t)wn, fifo->mem_size));
+	return (er_ssize_t)wn;
+}
+#endif
+
+#if ERB_MIRROR
+/**
+ * @brief 将一段memfd内存连续映射两次,写入mem[size+i]即写入mem[i]
+ * @param  size             映射大小,必须是页大小的整数倍
+ * @return uint8_t* 		成功返回映射首地址,失败返回NULL
+ */
+static uint8_t* erb_MirrorMap(uint32_t size)
+{
+	uint8_t *base;
+	int fd;
+
+	fd = memfd_create("erb", MFD_CLOEXEC);
+	if(fd < 0)
+		return NULL;
+	if(ftruncate(fd, size) < 0)
+		goto err_fd;
+
+	/* 先占住两倍大小的地址空间,再把同一个文件覆盖映射到前后两半 */
+	base = mmap(NULL, (size_t)size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(base == MAP_FAILED)
+		goto err_fd;
+	if(mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+		mmap(base + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+		goto err_map;
+
+	close(fd);
+	return base;
+err_map:
+	munmap(base, (size_t)size * 2);
+err_fd:
+	close(fd);
+	return NULL;
+}
+
+/**
+ * @brief 尝试以双重映射的方式新建环形缓冲区
  * @param  size             环形缓冲区的容量
+ * @return Erb* 			容量不是页大小整数倍或映射失败时返回NULL
+ */
+static Erb* erb_MirrorNew(uint32_t size)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	Erb *erb_new;
+
+	if(page <= 0 || size == 0 || size % (uint32_t)page)
+		return NULL;
+
+	erb_new = (Erb *)_er_malloc(sizeof(Erb));
+	if( erb_new == NULL )
+	{
+		return NULL;
+	}
+	erb_new->mem = erb_MirrorMap(size);
+	if( erb_new->mem == NULL )
+	{
+		_er_free(erb_new);
+		return NULL;
+	}
+	erb_new->mem_tmp 	= erb_new->mem + size;
+	erb_new->mem_size 	= size;
+	erb_new->read 		= erb_new->write = 0;
+	erb_new->is_static  = 0;
+	erb_new->is_mirror  = 1;
+	return erb_new;
+}
+#endif
+
+/**
+ * @brief 新建一个环形缓冲区
+ * @param  size             环形缓冲区的容量,linux下取页大小的整数倍时只占用一倍的内存
  * @return Erb* 			返回一个实例
  */
 Erb* erb_New(uint32_t size)
 {
 	Erb *erb_new;
+#if ERB_MIRROR
+	erb_new = erb_MirrorNew(size);
+	if( erb_new != NULL )
+	{
+		return erb_new;
+	}
+#endif
 	erb_new = (Erb *)_er_malloc(sizeof(Erb)+size * 2);
 	if( erb_new == NULL )
 	{
@@ -186,6 +439,7 @@ Erb* erb_New(uint32_t size)
 	erb_new->mem_size 	= size;
 	erb_new->read 		= erb_new->write = 0;
 	erb_new->is_static  = 0;
+	erb_new->is_mirror  = 0;
 	return erb_new;
 }
 
@@ -203,6 +457,7 @@ int erb_StaticNew(Erb* fifo, uint8_t* buf, uint32_t size)
 	fifo->mem_size 	= size;
 	fifo->read 		= fifo->write = 0;
 	fifo->is_static  = 1;
+	fifo->is_mirror  = 0;
 	return 0;
 }
 
@@ -213,6 +468,11 @@ int erb_StaticNew(Erb* fifo, uint8_t* buf, uint32_t size)
  */
 void erb_Del(Erb* fifo)
 {
-	if(!fifo->is_static)
-		_er_free(fifo);
+	if(fifo->is_static)
+		return;
+#if ERB_MIRROR
+	if(fifo->is_mirror)
+		munmap(fifo->mem, (size_t)fifo->mem_size * 2);
+#endif
+	_er_free(fifo);
 }
@@ -1,798 +1,4646 @@
-/**
- * @file hash_kv.c
- * @brief 内存KV数据库实现
- * @author simon.xiaoapeng (simon.xiaoapeng@gmail.com)
- * @version 1.0
- * @date 2020-01-20
- * 
- * @copyright Copyright (c) 2020  simon.xiaoapeng@gmail.com
- * 
- * @par 修改日志:
- */
-
-#include <stdint.h>
-#include <string.h>
-#include "typedef.h"
-#include "ulist.h"
-#include "hash_kv.h"
-
-
-unsigned int APHash(char* str, unsigned int len);
-unsigned int BKDRHash(char* str, unsigned int len);
-unsigned int BPHash(char* str, unsigned int len);
-unsigned int DEKHash(char* str, unsigned int len);
-unsigned int DJBHash(char* str, unsigned int len);
-unsigned int ELFHash(char* str, unsigned int len);
-unsigned int FNVHash(char* str, unsigned int len);
-
-
-#define HASH_FUNC	RSHash
-
-typedef uint32_t HashVal;
-
-typedef struct _HashItem{
-	void        	   *v;		/* 值 */
-	uint32_t			v_len;
-	struct list_head 	list;
-	uint32_t			count;	/* 被引用次数 */
-	char  				k[0];	/* 键 */
-}HashItem;						/* 哈希表数据项 */
-
-typedef struct _HashTabHead{
-	struct list_head head;		/* 链表头 */
-}HashTabHead;					/* 哈希表链表头数组 */
-
-typedef struct _HashKv{
-	int (*lock)(void);			/* 请提供递归锁 */
-	void (*unlock)(void);
-	uint32_t hash_tab_len;
-	HashTabHead  hash_tab[0];
-}HashKv;						/* 哈希表对象 */
-
-typedef struct _HashBlob{
-	HashKv 		*ht;
-	HashItem	*data_item;
-}HashBlob;						/* 哈希表数据特殊访问方式 */
-
-/* ############################## 哈希算法集合 ############################# */
-
-unsigned int RSHash(char* str, unsigned int len) 
-{
-  unsigned int b  = 378551; 
-  unsigned int a  = 63689; 
-  unsigned int hash = 0; 
-  unsigned int i  = 0; 
-  
-  for(i = 0; i < len; str++, i++) 
-  { 
-   hash = hash * a + (*str); 
-   a  = a * b; 
-  } 
-  
-  return hash; 
-}
-/* End Of RS Hash Function */
-
-
-unsigned int JSHash(char* str, unsigned int len) 
-{ 
-  unsigned int hash = 1315423911; 
-  unsigned int i  = 0; 
-  
-  for(i = 0; i < len; str++, i++) 
-  { 
-   hash ^= ((hash << 5) + (*str) + (hash >> 2)); 
-  } 
-  
-  return hash; 
-} 
-/* End Of JS Hash Function */
-
-
-unsigned int PJWHash(char* str, unsigned int len) 
-{ 
-  const unsigned int BitsInUnsignedInt = (unsigned int)(sizeof(unsigned int) * 8); 
-  const unsigned int ThreeQuarters   = (unsigned int)((BitsInUnsignedInt * 3) / 4); 
-  const unsigned int OneEighth     = (unsigned int)(BitsInUnsignedInt / 8); 
-  const unsigned int HighBits     = (unsigned int)(0xFFFFFFFF) << (BitsInUnsignedInt - OneEighth); 
-  unsigned int hash       = 0; 
-  unsigned int test       = 0; 
-  unsigned int i         = 0; 
-  
-  for(i = 0; i < len; str++, i++) 
-  { 
-   hash = (hash << OneEighth) + (*str); 
-  
-   if((test = hash & HighBits) != 0) 
-   { 
-     hash = (( hash ^ (test >> ThreeQuarters)) & (~HighBits)); 
-   } 
-  }
-  
-  return hash; 
-} 
-/* End Of P. J. Weinberger Hash Function */
-
-
-unsigned int ELFHash(char* str, unsigned int len) 
-{ 
-  unsigned int hash = 0; 
-  unsigned int x  = 0; 
-  unsigned int i  = 0; 
-  
-  for(i = 0; i < len; str++, i++) 
-  { 
-   hash = (hash << 4) + (*str); 
-   if((x = hash & 0xF0000000L) != 0) 
-   { 
-     hash ^= (x >> 24); 
-   } 
-   hash &= ~x; 
-  } 
-  
-  return hash; 
-} 
-/* End Of ELF Hash Function */
-
-
-unsigned int BKDRHash(char* str, unsigned int len) 
-{ 
-  unsigned int seed = 131; /* 31 131 1313 13131 131313 etc.. */
-  unsigned int hash = 0; 
-  unsigned int i  = 0; 
-  
-  for(i = 0; i < len; str++, i++) 
-  { 
-   hash = (hash * seed) + (*str); 
-  } 
-  
-  return hash; 
-} 
-/* End Of BKDR Hash Function */
-
-
-unsigned int SDBMHash(char* str, unsigned int len) 
-{ 
-  unsigned int hash = 0; 
-  unsigned int i  = 0; 
-  
-  for(i = 0; i < len; str++, i++) 
-  { 
-   hash = (*str) + (hash << 6) + (hash << 16) - hash; 
-  } 
-  
-  return hash; 
-} 
-/* End Of SDBM Hash Function */
-
-
-unsigned int DJBHash(char* str, unsigned int len) 
-{ 
-  unsigned int hash = 5381; 
-  unsigned int i  = 0; 
-  
-  for(i = 0; i < len; str++, i++) 
-  { 
-   hash = ((hash << 5) + hash) + (*str); 
-  } 
-  
-  return hash; 
-} 
-/* End Of DJB Hash Function */
-
-
-unsigned int DEKHash(char* str, unsigned int len) 
-{ 
-  unsigned int hash = len; 
-  unsigned int i  = 0; 
-  
-  for(i = 0; i < len; str++, i++) 
-  { 
-   hash = ((hash << 5) ^ (hash >> 27)) ^ (*str); 
-  } 
-  return hash; 
-} 
-/* End Of DEK Hash Function */
-  
-  
-unsigned int BPHash(char* str, unsigned int len) 
-{ 
-  unsigned int hash = 0; 
-  unsigned int i  = 0; 
-  for(i = 0; i < len; str++, i++) 
-  { 
-   hash = hash << 7 ^ (*str); 
-  } 
-  
-  return hash; 
-} 
-/* End Of BP Hash Function */
-  
-  
-unsigned int FNVHash(char* str, unsigned int len) 
-{ 
-  const unsigned int fnv_prime = 0x811C9DC5; 
-  unsigned int hash   = 0; 
-  unsigned int i     = 0; 
-  
-  for(i = 0; i < len; str++, i++) 
-  { 
-   hash *= fnv_prime; 
-   hash ^= (*str); 
-  } 
-  
-  return hash; 
-} 
-/* End Of FNV Hash Function */
-  
-  
-unsigned int APHash(char* str, unsigned int len) 
-{ 
-  unsigned int hash = 0xAAAAAAAA; 
-  unsigned int i  = 0; 
-  
-  for(i = 0; i < len; str++, i++) 
-  { 
-   hash ^= ((i & 1) == 0) ? ( (hash << 7) ^ (*str) * (hash >> 3)) : 
-                (~((hash << 11) + ((*str) ^ (hash >> 5)))); 
-  } 
-  
-  return hash; 
-} 
-/* End Of AP Hash Function */
-
-/* ######################################################################### */
-
-
-
-
-static inline HashTabHead* _HashSearch(HashKv *ht,const char* k)
-{
-	uint32_t hash_val = HASH_FUNC((char*)k,strlen(k)) % ht->hash_tab_len;
-	return ht->hash_tab + hash_val;
-}
-
-static inline HashItem* _TabSearch(HashTabHead *item,const char* k)
-{
-	HashItem	*data_item;
-	list_for_each_entry(data_item, &item->head , list)
-	{
-		if(!strcmp(data_item->k,k))
-			return data_item;
-	}
-	return NULL;
-}
-
-/* 整体:返回值为成功字节数 */
-static int _SetItemData(HashItem *data_item,const void* data,uint32_t data_len)
-{
-	void *v = NULL;
-	if(data_item->v_len == data_len)
-	{
-		memcpy(data_item->v,data,data_len);
-		return (int)data_len;
-	}else{
-		v = MALLOC(data_len);
-		if(v){
-			memcpy(v,data,data_len);
-			FREE(data_item->v);
-			data_item->v = v;
-			data_item->v_len = data_len;
-			return (int)data_len;
-		}else{
-			return -1;
-		}
-	}
-}
-
-/* 整体:返回值为成功字节数 */
-static int _GetItemData(HashItem *data_item,void* buf,uint32_t read_size)
-{
-	int rb = read_size > data_item->v_len ? data_item->v_len : read_size;
-	memcpy(buf, ((uint8_t*)data_item->v),rb);
-	return rb;
-}
-
-#if 0
-/* 分段:返回值为成功字节数 */
-static int _SetItemOffsetData(HashItem *data_item,const void* data,
-				uint32_t data_len,uint32_t offset)
-{
-	int wb = data_item->v_len - offset;	/* 可写空间 */
-	if(wb <= 0) return 0;
-	wb = wb > data_len? data_len : wb;
-	memcpy(((uint8_t*)data_item->v)+offset,data,wb);
-	return wb;
-}
-/* 分段:返回值为成功字节数 */
-static int _GetItemOffsetData(HashItem *data_item, void* buf,
-	uint32_t read_len,uint32_t offset)
-{
-	int rb = data_item->v_len - offset;	/* 可读数量 */
-	if(rb <= 0) return 0;
-	rb = rb > read_len? read_len : rb;	
-	memcpy(buf, ((uint8_t*)data_item->v)+offset,rb);
-	return rb;
-}
-#endif
-
-static inline void _DelItemData(HashItem *data_item)
-{
-	list_del(&data_item->list);
-	FREE(data_item->v);
-	FREE(data_item);
-}
-
-static inline int _MutexLock(HashKv *ht)
-{
-	if(ht->lock) 
-		return ht->lock();
-	return 0;
-}
-
-static inline void _MutexUnLock(HashKv *ht)
-{
-	if(ht->unlock) 
-		ht->unlock();
-}
-
-const char* hash_BlobGetKey(HashBlob_t *b)
-{
-	HashBlob *hb = (HashBlob*)b;
-	if(!b) return NULL;
-    return hb->data_item->k;
-}
-
-/*****************************************************************************
- 函 数 名  : hash_BlobSetData
- 功能描述  : 
- 	使用特殊方式设置数据
-  参数：
- 	ht 			由hash_New生成的HashKv_t
- 	k			键值
- 	data		数据缓冲区
- 	data_len	数据大小
-  返回值：
- 	成功返回写入的字节数,失败返回负数
-*****************************************************************************/
-int hash_BlobSetData(HashBlob_t *b,const void* data,uint32_t data_len)
-{
-	HashBlob	*hb = (HashBlob*)b;
-	int ret;
-
-	if(!b) return -1;
-
-	if(_MutexLock(hb->ht)) return -2;
-	ret = _SetItemData(hb->data_item,data,data_len);
-	_MutexUnLock(hb->ht);
-	return ret;
-}
-
-/*****************************************************************************
- 函 数 名  : hash_BlobGetData
- 功能描述  : 
- 	使用特殊方式读数据
-  参数：
- 	b 			由hash_AcquireBlob生成
- 	buf			数据缓冲区
- 	read_len		数据大小
-  返回值：
- 	成功返回获取的字节数,失败返回负数
-*****************************************************************************/
-int hash_BlobGetData(HashBlob_t * b, void * buf, uint32_t read_len)
-{
-	HashBlob	*hb = (HashBlob*)b;
-	int ret;
-	if(!b) return -1;
-	if(!hb->data_item || !hb->ht ) return -1;
-	if(_MutexLock(hb->ht)) return -2;
-	ret = _GetItemData(hb->data_item,buf,read_len);
-	_MutexUnLock(hb->ht);
-	return ret;
-}
-
-
-/*****************************************************************************
- 函 数 名  : hash_AcquireBlob
- 功能描述  : 
- 	获取特殊方式对象	HashBlob_t
-  参数：
- 	ht 			由hash_New生成的HashKv_t
- 	k			键值
- 	b			输出参数，请到上层实例化
-  返回值：
- 	成功返回0,失败返回负数
-*****************************************************************************/
-int hash_AcquireBlob(HashKv_t ht, HashBlob_t *b,char* k)
-{
-	HashKv		*obj = (HashKv*)ht;
-	HashTabHead *tab_item;
-	HashItem	*data_item;
-	HashBlob	*hb = (HashBlob*)b;
-	if(!obj || !b) return -1;
-	
-	if(_MutexLock(obj)) return -2;
-	tab_item = _HashSearch(obj,k);
-	data_item = _TabSearch(tab_item,k);
-	
-	if(!data_item){
-		_MutexUnLock(obj);
-		return -1;
-	}
-	hb->data_item = data_item;
-	hb->ht = obj;
-	data_item->count++;
-	_MutexUnLock(obj);
-	return 0;
-}
-
-/*****************************************************************************
- 函 数 名  : hash_ReleaseBlob
- 功能描述  : 
- 	释放HashBlob_t引用减1
-  参数：
- 	b			由hash_AcquireBlob生成
-  返回值：
- 	成功返回0,失败返回负数
-*****************************************************************************/
-int hash_ReleaseBlob(HashBlob_t *b)
-{
-	HashBlob	*hb = (HashBlob*)b;
-	HashKv 		*ht;
-	if(!b) return -1;
-
-	if(!hb->data_item || !hb->ht ) return 0;
-	ht = hb->ht;
-	if(_MutexLock(ht)) return -2;
-	if(hb->data_item->count > 0)
-		hb->data_item->count--;
-	hb->data_item = NULL;
-	hb->ht = NULL;
-	_MutexUnLock(ht);	
-	return 0;
-}
-
-/*****************************************************************************
- 函 数 名  : hash_DelKeyFormBlob
- 功能描述  : 
- 	利用Blob删除键值对,只有引用为0时才真正删除
-  参数：
- 	b			由hash_AcquireBlob生成
-  返回值：
- 	成功返回0,失败返回负数
-*****************************************************************************/
-int hash_DelKeyFormBlob(HashBlob_t *b)
-{
-	HashBlob	*hb = (HashBlob*)b;
-	if(!b) return -1;
-
-	if(!hb->data_item || !hb->ht ) return -1;
-
-	if(_MutexLock(hb->ht)) return -2;
-	if(hb->data_item->count > 0)
-		hb->data_item->count--;
-	hb->data_item = NULL;
-	hb->ht = NULL;
-	if(hb->data_item->count == 0)
-		_DelItemData(hb->data_item);
-	_MutexUnLock(hb->ht);
-	return 0;
-}
-
-
-
-/*****************************************************************************
- 函 数 名  : hash_DelKey
- 功能描述  : 
- 	获取值
-  参数：
- 	ht 			由hash_New生成的HashKv_t
- 	k			键值
-  返回值：
- 	成功返回0,失败返回-1
-*****************************************************************************/
-int hash_DelKey(HashKv_t ht,const char* k)
-{
-	HashKv		*obj = (HashKv*)ht;
-	HashTabHead *tab_item;
-	HashItem	*data_item;
-	if(!obj) return -1;
-	
-	if(_MutexLock(obj)) return -2;
-	tab_item = _HashSearch(obj,k);
-	data_item = _TabSearch(tab_item,k);
-
-	if(!data_item || data_item->count){
-		_MutexUnLock(obj);
-		return -1;
-	}
-	
-	_DelItemData(data_item);
-	_MutexUnLock(obj);
-	return 0;
-}
-
-/*****************************************************************************
- 函 数 名  : hash_NewData
- 功能描述  : 
- 	新建一个数据项
-  参数：
- 	ht 			由hash_New生成的HashKv_t
- 	k			键值
-  返回值：
- 	成功返回0,失败返回负数
-*****************************************************************************/
-int hash_NewData(HashKv_t ht,const char* k,uint32_t data_len)
-{
-	HashKv		*obj = (HashKv*)ht;
-	HashTabHead *tab_item;
-	HashItem	*data_item;
-	
-	if(!obj)  return -1;
-	
-	if(_MutexLock(obj)) return -2;
-	
-	tab_item = _HashSearch(obj,k);
-	data_item = _TabSearch(tab_item,k);
-	if(data_item)
-	{
-		_MutexUnLock(obj);	/* 本来就存在 */
-		return -3;
-	}
-
-	/* 不存在的项,新建 */
-	data_item = MALLOC(sizeof(*data_item) + strlen(k)+1);
-	if(!data_item)
-		goto alloc_di;
-	data_item->v = MALLOC(data_len);
-	if(!data_item->v)
-		goto alloc_v;
-	memset(data_item->v,0,data_len);
-	data_item->count = 0;
-	data_item->v_len = data_len;
-	strcpy(data_item->k,k);
-	list_add(&data_item->list, &tab_item->head);
-	_MutexUnLock(obj);
-	
-	return 0;
-alloc_v:
-	FREE(data_item);
-alloc_di:
-	_MutexUnLock(obj);
-	return -1;
-}
-
-
-/*****************************************************************************
- 函 数 名  : hash_SetData
- 功能描述  : 
- 	设置值，对于不存在的值会自动新建
-  参数：
- 	ht 			由hash_New生成的HashKv_t
- 	k			键值
- 	data		数据缓冲区 
- 	data_len	数据大小，必须大于0
-  返回值：
- 	成功返回设置的字节数,失败返回负数
-*****************************************************************************/
-int hash_SetData(HashKv_t ht,const char* k,const void* data,uint32_t data_len)
-{
-	HashKv		*obj = (HashKv*)ht;
-	HashTabHead *tab_item;
-	HashItem	*data_item;
-	int 		ret = 0;
-	
-	if(!obj || data_len == 0 || !data)  return -1;
-	
-	if(_MutexLock(obj)) return -2;
-	
-	tab_item = _HashSearch(obj,k);
-	data_item = _TabSearch(tab_item,k);
-	if(data_item)
-	{
-		ret = _SetItemData(data_item, data, data_len);
-		_MutexUnLock(obj);
-		return ret;
-	}	
-
-	/* 不存在的项,新建 */
-	data_item = MALLOC(sizeof(*data_item) + strlen(k)+1);
-	if(!data_item)
-		goto alloc_di;
-	data_item->v = MALLOC(data_len);
-	if(!data_item->v)
-		goto alloc_v;
-	memcpy(data_item->v,data,data_len);
-	data_item->count = 0;
-	data_item->v_len = data_len;
-	strcpy(data_item->k,k);
-	list_add(&data_item->list, &tab_item->head);
-	_MutexUnLock(obj);
-	
-	return data_len;
-	
-alloc_v:
-	FREE(data_item);
-alloc_di:
-	_MutexUnLock(obj);
-	return -1;
-}
-
-
-
-
-/*****************************************************************************
- 函 数 名  : hash_GetData
- 功能描述  : 
- 	获取值
-  参数：
- 	ht 			由hash_New生成的HashKv_t
- 	k			键值
- 	buf			缓冲区
- 	read_size	要读的大小
-  返回值：
- 	成功返回读到的字节数,失败返回负数
-*****************************************************************************/
-int hash_GetData(HashKv_t ht,const char* k,void* buf,uint32_t read_size)
-{
-	HashKv		*obj = (HashKv*)ht;
-	HashTabHead *tab_item;
-	HashItem	*data_item;
-	int 		ret = 0;
-	if(!obj) return -1;	
-	if(_MutexLock(obj)) return -1;
-	
-	tab_item = _HashSearch(obj,k);
-	data_item = _TabSearch(tab_item,k);
-	if(data_item)
-	{
-		ret = _GetItemData(data_item, buf, read_size);
-		goto out;
-	}else{
-		ret = -1;
-	}
-	
-out:
-	_MutexUnLock(obj);
-	return ret;
-}
-
-
-
-int hash_Iteration(HashKv_t ht, 
-	enum HashIterState (*processor)(void* param,HashBlob_t* ),void *param)
-{
-	HashKv		*obj = (HashKv*)ht;
-	HashTabHead *item;
-	HashItem	*data_item;
-	HashItem	*work_item;
-	HashBlob	Blob;
-	int			i;
-	enum 		HashIterState state;
-	
-	if(obj == NULL)	return -1;
-
-	if(_MutexLock(obj)) return -2;
-
-	
-	item = obj->hash_tab;	
-	for(i=0;i<obj->hash_tab_len ;i++)
-	{
-		list_for_each_entry_safe(data_item, work_item, &item[i].head , list)
-		{
-			Blob.data_item = data_item;			
-			Blob.ht = obj;
-			
-			data_item->count++;
-			if( &work_item->list != &item[i].head)
-				work_item->count++;	/* 提前将下一个引用,防止被误删造成bug */
-			
-			_MutexUnLock(obj);	/* 释放锁 */
-			state = processor(param,(HashBlob_t*)&Blob);
-			
-			if(_MutexLock(obj))
-			{
-				if(&work_item->list != &item[i].head)
-					work_item->count--; /* 即使获取不到锁也要强行去掉引用 */
-				return -2;
-			}
-			if(&work_item->list != &item[i].head)
-				work_item->count--; /*去掉引用 */
-			if(state == ITER_EXIT)
-			{
-				_MutexUnLock(obj);	/* 释放锁 */
-				return 0;
-			}
-		}
-	}
-	_MutexUnLock(obj);	/* 释放锁 */
-	return 0;
-}
-
-/*****************************************************************************
- 函 数 名  : hash_GetData
- 功能描述  : 
- 	获取值
-  参数：
- 	ht 			由hash_New生成的HashKv_t
- 	k			键值
- 	buf			缓冲区
- 	read_size	要读的大小
-  返回值：
- 	成功返回读到的字节数,失败返回负数
-*****************************************************************************/
-void hash_SetLock(HashKv_t ht,int (*lock)(void),void (*unlock)(void))
-{
-	HashKv		*obj = (HashKv*)ht;
-	if(obj){
-		obj->lock 	= lock;
-		obj->unlock = unlock;
-	}
-}
-
-/*****************************************************************************
- 函 数 名  : hash_Del
- 功能描述  : 
- 	删除哈希表
- 参数：
- 	ht 			由hash_New生成的HashKv_t
- *****************************************************************************/
-void hash_Del(HashKv_t ht)
-{
-	HashKv		*obj = (HashKv*)ht;
-	HashTabHead *item;
-	HashItem	*data_item;
-	HashItem	*work_item;
-	
-	int			i;
-	if(obj == NULL)	return ;
-	item = obj->hash_tab;
-	/* 先一项一项释放，最后再一起释放 */
-	
-	for(i=0;i<obj->hash_tab_len ;i++)
-	{
-		list_for_each_entry_safe(data_item, work_item, &item[i].head , list)
-		{
-			_DelItemData(data_item);
-		}
-	}
-	FREE(obj);
-}
-
-
-
-/*****************************************************************************
- 函 数 名  : hash_New
- 功能描述  : 
- 	新建一个hash表
- 参数：
- 	tab_len hash表的长度，关系到hash表的效率
- 返回值：
- 	成功返回哈希表对象，失败返回NULL
-*****************************************************************************/
-HashKv_t hash_New(uint32_t tab_len)
-{
-	int i;
-	HashKv 		*obj;
-	HashTabHead *item;
-	
-	if(tab_len == 0) return NULL;
-	
-	obj = MALLOC(sizeof(HashKv) + sizeof(HashTabHead)*tab_len);
-	if(obj == NULL) return NULL;
-	obj->hash_tab_len = tab_len;
-	obj->lock = NULL;
-	obj->unlock = NULL;
-	item = obj->hash_tab;
-
-	for(i=0;i<tab_len;i++)
-	{
-		/* 初始化每一项 */
-		INIT_LIST_HEAD(&item->head);
-		item++;
-	}
-	return (HashKv_t)obj;
-}
-
-
-
+/**
+ * @file hash_kv.c
+ * @brief 内存KV数据库实现
+ * @author simon.xiaoapeng (simon.xiaoapeng@gmail.com)
+ * @version 1.0
+ * @date 2020-01-20
+ * 
+ * @copyright Copyright (c) 2020  simon.xiaoapeng@gmail.com
+ * 
+ * @par 修改日志:
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "typedef.h"
+#include "ulist.h"
+#include "hash_kv.h"
+
+/* ######################################################################## */
+/* ################################ CONFIG ################################ */
+#if defined(__unix__) || defined(__APPLE__)
+#define HASH_KV_USE_PLATFORM_POSIX	1	/* 平台提供POSIX接口,单片机与windows下为0 */
+#else
+#define HASH_KV_USE_PLATFORM_POSIX	0
+#endif
+#define HASH_KV_USE_RCU				HASH_KV_USE_PLATFORM_POSIX	/* 读多写少模式,需要C11原子操作与_Thread_local */
+#define HASH_KV_USE_SLAB			1	/* 数据项与小块值从每个表自己的slab中分配 */
+#define HASH_SLAB_PAGE				4096	/* slab每次向系统申请的字节数 */
+#define HASH_INLINE_MAX				16	/* 不超过此长度的值直接存放在数据项中 */
+#define HASH_KV_USE_IMAGE			HASH_KV_USE_PLATFORM_POSIX	/* 表镜像的保存/加载/只读映射,需要POSIX mmap */
+#define HASH_KV_USE_THREAD			HASH_KV_USE_PLATFORM_POSIX	/* 并行遍历与并行批量写入,需要pthread */
+#define HASH_KV_USE_WATCH			HASH_KV_USE_PLATFORM_POSIX	/* 键变更通知,事件放入pfifo,需要C11原子操作 */
+#define HASH_WATCH_QUEUE			4096	/* 每个分片的事件队列字节数 */
+#define HASH_WATCH_KEY_MAX			255		/* 超过此长度的键变更时只能报告队列溢出 */
+/* ######################################################################## */
+
+#if HASH_KV_USE_RCU
+#include <stdatomic.h>
+#include <sched.h>
+#define HASH_RCU_SLOTS				64	/* 读者计数槽数量,线程按编号散列到各个槽 */
+#define HASH_RCU_RETIRE_BATCH		64	/* 待回收对象攒够这么多后统一等待宽限期 */
+#define HASH_RCU_RETIRE_MAX			(HASH_RCU_RETIRE_BATCH * 32)	/* 宽限期迟迟不结束时,待回收对象超过此数才阻塞等待 */
+#define HASH_READ_ONCE(x)			(*(volatile typeof(x) *)&(x))
+#define HASH_WRITE_ONCE(x, val)		(*(volatile typeof(x) *)&(x) = (val))
+#else
+#define HASH_READ_ONCE(x)			(x)		/* 没有不加锁的读者,普通访问即可 */
+#define HASH_WRITE_ONCE(x, val)		((x) = (val))
+#endif
+
+#if HASH_KV_USE_IMAGE
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "crc_check.h"
+#endif
+
+#if HASH_KV_USE_THREAD
+#include <pthread.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#define HASH_PAR_THREADS_MAX		64		/* 并行操作的最大线程数 */
+#define HASH_PAR_CHUNK				1024	/* 并行操作每个任务处理的桶/键数量 */
+#endif
+
+#if HASH_KV_USE_WATCH
+#include <stdatomic.h>
+#include "pfifo.h"
+#define HASH_WATCH_BATCH			1024	/* 消费者每批从队列取出的字节数 */
+#endif
+
+
+unsigned int APHash(char* str, unsigned int len);
+unsigned int BKDRHash(char* str, unsigned int len);
+unsigned int BPHash(char* str, unsigned int len);
+unsigned int DEKHash(char* str, unsigned int len);
+unsigned int DJBHash(char* str, unsigned int len);
+unsigned int ELFHash(char* str, unsigned int len);
+unsigned int FNVHash(char* str, unsigned int len);
+unsigned int JSHash(char* str, unsigned int len);
+unsigned int PJWHash(char* str, unsigned int len);
+unsigned int RSHash(char* str, unsigned int len);
+unsigned int SDBMHash(char* str, unsigned int len);
+
+
+#define HASH_POLICY_DEFAULT	HASH_POLICY_RS
+
+typedef uint32_t HashVal;
+
+typedef struct _HashItem{
+	void        	   *v;		/* 值 */
+	uint32_t			v_len;
+	uint32_t			watch;	/* 变更事件入队时的批次号,用于合并重复的事件 */
+	struct list_head 	list;
+	uint32_t			count;	/* 被引用次数 */
+	uint32_t			views;	/* 只读视图数量,不为0时值不能搬家 */
+	uint32_t			hash;	/* 键的哈希值,查找时先比较它和长度 */
+	uint32_t			k_len;	/* 键长度,不含结尾的0 */
+	uint32_t			expire;	/* 过期时刻(GET_TICK),0表示永不过期 */
+	uint8_t				flags;	/* HASH_ITEM_* */
+	uint8_t				ref;	/* CLOCK访问位,被访问时置1 */
+	char  				k[0];	/* 键 */
+}HashItem;						/* 哈希表数据项 */
+
+#define HASH_ITEM_INLINE	0x01	/* 键后面预留了 HASH_INLINE_MAX 字节的值空间 */
+
+typedef struct _HashRcuVal{
+	struct _HashRcuVal	*next;	/* 等待回收时串联 */
+	uint32_t			len;	/* 值的长度,与data一起发布,读者看到的总是一致的 */
+	uint32_t			reserve;
+	uint8_t				data[0];
+}HashRcuVal;					/* 读多写少模式下值的版本 */
+
+#if HASH_KV_USE_RCU
+typedef struct _HashRcuSlot{
+	atomic_uint			cnt[2];	/* 按宽限期奇偶分别计数的读者数量 */
+	atomic_ullong		hit;	/* 无锁读的命中/未命中次数,按槽分散计数 */
+	atomic_ullong		miss;
+	uint8_t				pad[64 - 2 * sizeof(atomic_uint) - 2 * sizeof(atomic_ullong)];
+}HashRcuSlot;					/* 读者计数槽,独占一条缓存行 */
+#endif
+
+/* 
+ * 表镜像: 头部之后是桶数组,每个桶记录第一个数据项相对镜像起始的偏移,
+ * 数据项之间通过next串联,next总是小于自身的偏移,因此不会成环
+ * 所有字段按本机字节序存放
+ */
+#define HASH_IMAGE_MAGIC	0x31564B48	/* "HKV1" */
+#define HASH_IMAGE_VERSION	1
+#define HASH_IMAGE_ALIGN(x)	(((x) + 7) & ~(uint64_t)7)
+
+typedef struct _HashImageHead{
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	policy;			/* 生成镜像时的哈希算法 */
+	uint32_t	len;			/* 桶数量,2的幂 */
+	uint32_t	num;			/* 数据项数量 */
+	uint32_t	crc;			/* 头部之后所有内容的crc32 */
+	uint64_t	size;			/* 镜像总字节数 */
+}HashImageHead;
+
+typedef struct _HashImageItem{
+	uint32_t	next;			/* 同一个桶的下一项,0表示结束 */
+	uint32_t	hash;
+	uint32_t	k_len;
+	uint32_t	v_len;
+	char		k[0];			/* 键,以0结尾,之后按8字节对齐存放值 */
+}HashImageItem;					/* 镜像中的数据项 */
+
+typedef struct _HashTabHead{
+	struct list_head head;		/* 链表头 */
+}HashTabHead;					/* 哈希表链表头数组 */
+
+typedef struct _HashTab{
+	uint32_t	len;			/* 桶/槽数量,总是2的幂,为0表示未分配 */
+	uint32_t	used;			/* 数据项数量 */
+	uint32_t	tomb;			/* 开放寻址: 墓碑数量 */
+	HashTabHead	*head;			/* 拉链法: 链表头数组 */
+	uint32_t	*tag;			/* 开放寻址: 指纹数组,与slot一一对应 */
+	HashItem	**slot;			/* 开放寻址: 数据项数组 */
+}HashTab;						/* 哈希表桶数组 */
+
+#if HASH_KV_USE_SLAB
+#define HASH_SLAB_CLASSES	12
+#define HASH_SLAB_MAX		256	/* 最大尺寸类,更大的对象直接MALLOC */
+#define HASH_SLAB_HEAD		16	/* 页首保留,用于串联所有页 */
+#endif
+
+typedef struct _HashSlab{
+#if HASH_KV_USE_SLAB
+	void		*free[HASH_SLAB_CLASSES];	/* 各尺寸类的空闲链表 */
+	void		*page;		/* 已申请的页 */
+	uint8_t		*cur;		/* 当前页中尚未切分的部分 */
+	uint32_t	left;
+#endif
+	HashMemStats st;
+}HashSlab;						/* 表内存分配器,与表共用同一把锁 */
+
+#if HASH_KV_USE_WATCH
+typedef struct _HashWatchKey{
+	uint32_t	len;
+	uint8_t		exact;			/* 1:只匹配这个键 0:匹配以它开头的所有键 */
+	char		*key;
+}HashWatchKey;
+
+typedef struct _HashWatchQueue{
+	struct pfifo_rec_ptr_2 fifo;	/* 记录: 1字节事件类型 + 键 */
+	atomic_uint	gen;			/* 批次号,消费者每取走一批加1 */
+	atomic_int	overflow;		/* 有事件因队列满被丢弃 */
+}HashWatchQueue;
+
+typedef struct _HashWatch{
+	HashWatchKey *key;			/* 关注的键与前缀,注册时锁住所有分片 */
+	uint32_t	num;
+	uint32_t	shard_num;
+	HashWatchQueue q[0];		/* 每个分片一个队列 */
+}HashWatch;						/* 变更通知,分片表的所有分片共用 */
+#endif
+
+typedef struct _HashKv{
+	int (*lock)(void);			/* 请提供递归锁 */
+	void (*unlock)(void);
+	int (*shard_lock)(uint32_t shard);		/* 分片锁,优先于lock使用 */
+	void (*shard_unlock)(uint32_t shard);
+	uint32_t	shard_id;		/* 本分片的编号 */
+	uint32_t	shard_bits;		/* 分片数量为 1<<shard_bits */
+	struct _HashKv **shard;		/* 分片数组,为NULL表示未分片 */
+	enum HashEngine engine;		/* 存储引擎 */
+	enum HashPolicy policy;		/* 哈希算法 */
+	uint32_t	iterators;		/* 正在进行的迭代数量, 迭代期间暂停rehash */
+	uint32_t	rehash_idx;		/* 渐进式rehash的进度, tab[1].len不为0时有效 */
+	uint32_t	min_len;		/* 缩容时的最小长度 */
+	uint8_t		grow;			/* 拉链法: 是否自动扩容 */
+	uint8_t		shrink;			/* 是否自动缩容 */
+	uint8_t		rcu;			/* 读多写少模式: 读操作不加锁,写操作发布新版本 */
+	HashTab		tab[2];			/* tab[0]为主表, rehash期间数据项逐步迁移到tab[1] */
+	HashSlab	slab;
+	uint64_t	mem_budget;		/* 内存上限,超出时按CLOCK淘汰,0表示不限制 */
+	uint32_t	clock_idx;		/* CLOCK指针: 当前扫到的桶 */
+	uint32_t	sweep_idx;		/* 过期清理的进度 */
+	uint8_t		clock_tab;		/* CLOCK指针所在的表 */
+	uint8_t		sweep_tab;
+	HashCacheStats cst;
+#if HASH_KV_USE_WATCH
+	HashWatch	*watch;			/* 为NULL表示没有关注任何键 */
+#endif
+#if HASH_KV_USE_IMAGE
+	const uint8_t *image;		/* 映射的只读镜像,不为NULL时表不可修改 */
+	uint64_t	image_size;
+#endif
+#if HASH_KV_USE_RCU
+	atomic_uint	rcu_epoch;		/* 宽限期计数,最低位选择读者计数 */
+	HashRcuSlot	*rcu_slot;
+	HashItem	*retire_item;	/* 等待回收的数据项,通过list.prev串联 */
+	HashRcuVal	*retire_val;	/* 等待回收的值 */
+	uint32_t	retire_num;
+	HashItem	*grace_item;	/* 正在等待宽限期的一批数据项 */
+	HashRcuVal	*grace_val;
+	uint8_t		grace_phase;	/* 0:没有进行中的宽限期 1、2:第几次翻转后等待旧计数归零 */
+	uint8_t		grace_scan;		/* 下一个要检查的读者计数槽 */
+#endif
+}HashKv;						/* 哈希表对象 */
+
+/* 开放寻址指纹: 0 与 1 被保留 */
+#define HASH_TAG_EMPTY		0	/* 空槽,探测到此处结束 */
+#define HASH_TAG_TOMB		1	/* 墓碑,已删除但探测需继续 */
+#define HASH_MIN_LEN		8	/* 最小桶/槽数量 */
+#define HASH_REHASH_STEP	4	/* 每次操作迁移的桶数量 */
+#define HASH_BATCH_STACK	64	/* 不超过此数量的批量操作不额外申请内存 */
+#define HASH_BATCH_PREFETCH	4	/* 批量操作提前预取后面第几个键的桶 */
+
+typedef struct _HashBlob{
+	HashKv 		*ht;
+	HashItem	*data_item;
+}HashBlob;						/* 哈希表数据特殊访问方式 */
+
+typedef struct _HashScan{
+	HashKv		*ht;
+	uint64_t	pos;			/* 本分片中下一个要访问的游标位置 */
+	uint32_t	shard;			/* 正在遍历的分片 */
+}HashScan;						/* 游标遍历的状态,不持有任何引用 */
+
+typedef struct _HashBatch{
+	HashKv		*obj;			/* 键所在的分片 */
+	uint32_t	hash;
+	uint32_t	k_len;
+	uint32_t	idx;			/* 在调用者数组中的下标 */
+}HashBatch;						/* 批量操作中的一个键 */
+
+enum HashBatchOp
+{
+	HASH_BATCH_GET,
+	HASH_BATCH_SET,
+	HASH_BATCH_DEL,
+};
+
+/* ############################## 哈希算法集合 ############################# */
+
+unsigned int RSHash(char* str, unsigned int len) 
+{
+  unsigned int b  = 378551; 
+  unsigned int a  = 63689; 
+  unsigned int hash = 0; 
+  unsigned int i  = 0; 
+  
+  for(i = 0; i < len; str++, i++) 
+  { 
+   hash = hash * a + (*str); 
+   a  = a * b; 
+  } 
+  
+  return hash; 
+}
+/* End Of RS Hash Function */
+
+
+unsigned int JSHash(char* str, unsigned int len) 
+{ 
+  unsigned int hash = 1315423911; 
+  unsigned int i  = 0; 
+  
+  for(i = 0; i < len; str++, i++) 
+  { 
+   hash ^= ((hash << 5) + (*str) + (hash >> 2)); 
+  } 
+  
+  return hash; 
+} 
+/* End Of JS Hash Function */
+
+
+unsigned int PJWHash(char* str, unsigned int len) 
+{ 
+  const unsigned int BitsInUnsignedInt = (unsigned int)(sizeof(unsigned int) * 8); 
+  const unsigned int ThreeQuarters   = (unsigned int)((BitsInUnsignedInt * 3) / 4); 
+  const unsigned int OneEighth     = (unsigned int)(BitsInUnsignedInt / 8); 
+  const unsigned int HighBits     = (unsigned int)(0xFFFFFFFF) << (BitsInUnsignedInt - OneEighth); 
+  unsigned int hash       = 0; 
+  unsigned int test       = 0; 
+  unsigned int i         = 0; 
+  
+  for(i = 0; i < len; str++, i++) 
+  { 
+   hash = (hash << OneEighth) + (*str); 
+  
+   if((test = hash & HighBits) != 0) 
+   { 
+     hash = (( hash ^ (test >> ThreeQuarters)) & (~HighBits)); 
+   } 
+  }
+  
+  return hash; 
+} 
+/* End Of P. J. Weinberger Hash Function */
+
+
+unsigned int ELFHash(char* str, unsigned int len) 
+{ 
+  unsigned int hash = 0; 
+  unsigned int x  = 0; 
+  unsigned int i  = 0; 
+  
+  for(i = 0; i < len; str++, i++) 
+  { 
+   hash = (hash << 4) + (*str); 
+   if((x = hash & 0xF0000000L) != 0) 
+   { 
+     hash ^= (x >> 24); 
+   } 
+   hash &= ~x; 
+  } 
+  
+  return hash; 
+} 
+/* End Of ELF Hash Function */
+
+
+unsigned int BKDRHash(char* str, unsigned int len) 
+{ 
+  unsigned int seed = 131; /* 31 131 1313 13131 131313 etc.. */
+  unsigned int hash = 0; 
+  unsigned int i  = 0; 
+  
+  for(i = 0; i < len; str++, i++) 
+  { 
+   hash = (hash * seed) + (*str); 
+  } 
+  
+  return hash; 
+} 
+/* End Of BKDR Hash Function */
+
+
+unsigned int SDBMHash(char* str, unsigned int len) 
+{ 
+  unsigned int hash = 0; 
+  unsigned int i  = 0; 
+  
+  for(i = 0; i < len; str++, i++) 
+  { 
+   hash = (*str) + (hash << 6) + (hash << 16) - hash; 
+  } 
+  
+  return hash; 
+} 
+/* End Of SDBM Hash Function */
+
+
+unsigned int DJBHash(char* str, unsigned int len) 
+{ 
+  unsigned int hash = 5381; 
+  unsigned int i  = 0; 
+  
+  for(i = 0; i < len; str++, i++) 
+  { 
+   hash = ((hash << 5) + hash) + (*str); 
+  } 
+  
+  return hash; 
+} 
+/* End Of DJB Hash Function */
+
+
+unsigned int DEKHash(char* str, unsigned int len) 
+{ 
+  unsigned int hash = len; 
+  unsigned int i  = 0; 
+  
+  for(i = 0; i < len; str++, i++) 
+  { 
+   hash = ((hash << 5) ^ (hash >> 27)) ^ (*str); 
+  } 
+  return hash; 
+} 
+/* End Of DEK Hash Function */
+  
+  
+unsigned int BPHash(char* str, unsigned int len) 
+{ 
+  unsigned int hash = 0; 
+  unsigned int i  = 0; 
+  for(i = 0; i < len; str++, i++) 
+  { 
+   hash = hash << 7 ^ (*str); 
+  } 
+  
+  return hash; 
+} 
+/* End Of BP Hash Function */
+  
+  
+unsigned int FNVHash(char* str, unsigned int len) 
+{ 
+  const unsigned int fnv_prime = 0x811C9DC5; 
+  unsigned int hash   = 0; 
+  unsigned int i     = 0; 
+  
+  for(i = 0; i < len; str++, i++) 
+  { 
+   hash *= fnv_prime; 
+   hash ^= (*str); 
+  } 
+  
+  return hash; 
+} 
+/* End Of FNV Hash Function */
+  
+  
+unsigned int APHash(char* str, unsigned int len) 
+{ 
+  unsigned int hash = 0xAAAAAAAA; 
+  unsigned int i  = 0; 
+  
+  for(i = 0; i < len; str++, i++) 
+  { 
+   hash ^= ((i & 1) == 0) ? ( (hash << 7) ^ (*str) * (hash >> 3)) : 
+                (~((hash << 11) + ((*str) ^ (hash >> 5)))); 
+  } 
+  
+  return hash; 
+} 
+/* End Of AP Hash Function */
+
+
+/* 
+ * 按字处理的哈希(wyhash风格),每轮消耗16字节
+ * _WyHash 用于已知长度的键, _WyHashStr 在同一趟扫描中求出字符串长度,
+ * 两者对相同的字节序列得到相同的结果
+ */
+#define WY_S0	0xa0761d6478bd642fULL
+#define WY_S1	0xe7037ed1a0b428dbULL
+#define WY_S2	0x8ebc6af09c88c6dbULL
+#define WY_ONES	0x0101010101010101ULL
+#define WY_HIGH	0x8080808080808080ULL
+#define WY_PAGE	4096
+
+static inline uint64_t _WyMum(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+	__uint128_t r = (__uint128_t)a * b;
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+	uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32), c = t < rl;
+	uint64_t lo = t + (rm1 << 32);
+	c += lo < t;
+	return lo ^ (rh + (rm0 >> 32) + (rm1 >> 32) + c);
+#endif
+}
+
+/* 以小端方式读取8字节 */
+static inline uint64_t _WyLoad(const uint8_t *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+static inline uint32_t _WyFinal(uint64_t seed, uint64_t a, uint64_t b, uint32_t len)
+{
+	seed = _WyMum(a ^ WY_S1, b ^ seed);
+	seed = _WyMum(seed ^ WY_S2, len ^ WY_S1);
+	return (uint32_t)(seed ^ (seed >> 32));
+}
+
+/* 已知长度的键 */
+static inline uint32_t _WyHash(const void *key, uint32_t len)
+{
+	const uint8_t	*p = key;
+	uint64_t		seed = WY_S0;
+	uint64_t		a = 0, b = 0;
+	uint32_t		i = len;
+
+	for(; i >= 16; i -= 16, p += 16)
+		seed = _WyMum(_WyLoad(p) ^ WY_S1, _WyLoad(p + 8) ^ seed);
+	if(i > 8){
+		a = _WyLoad(p);
+		memcpy(&b, p + 8, i - 8);
+	}else{
+		memcpy(&a, p, i);
+	}
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	if(i > 8) b = __builtin_bswap64(b);
+	else a = __builtin_bswap64(a);
+#endif
+	return _WyFinal(seed, a, b, len);
+}
+
+/* 
+ * 读取字符串中的下一个字,结尾之后的字节视为0
+ * 不跨页时整字读取,即使越过字符串结尾也不会访问到无效内存
+ */
+typedef uint64_t __attribute__((may_alias, aligned(1))) _wy_u64_unaligned;
+
+__attribute__((no_sanitize_address))
+static inline uint64_t _WyLoadStr(const uint8_t *p, uint32_t *n)
+{
+	uint64_t	v, m;
+	uint32_t	i;
+
+	if(((uintptr_t)p & (WY_PAGE - 1)) <= WY_PAGE - 8){
+		/* 不经过 memcpy,避免越过结尾的整字读取被检测工具拦截 */
+		v = *(const _wy_u64_unaligned *)p;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		v = __builtin_bswap64(v);
+#endif
+	}else{
+		for(v = 0, i = 0; i < 8 && p[i]; i++)
+			v |= (uint64_t)p[i] << (i * 8);
+	}
+	m = (v - WY_ONES) & ~v & WY_HIGH;
+	if(!m){
+		*n = 8;
+		return v;
+	}
+	*n = __builtin_ctzll(m) >> 3;	/* 第一个0字节的位置 */
+	return *n ? v & (~0ULL >> (64 - *n * 8)) : 0;
+}
+
+__attribute__((no_sanitize_address))
+static uint32_t _WyHashStr(const char *k, uint32_t *len)
+{
+	const uint8_t	*p = (const uint8_t *)k;
+	uint64_t		seed = WY_S0;
+	uint64_t		a, b;
+	uint32_t		n, l = 0;
+
+	for(;;)
+	{
+		a = _WyLoadStr(p, &n);
+		l += n;
+		if(n < 8){
+			b = 0;
+			break;
+		}
+		b = _WyLoadStr(p + 8, &n);
+		l += n;
+		if(n < 8)
+			break;
+		seed = _WyMum(a ^ WY_S1, b ^ seed);
+		p += 16;
+	}
+	*len = l;
+	return _WyFinal(seed, a, b, l);
+}
+
+static unsigned int (* const _hash_funcs[])(char* str, unsigned int len) = {
+	[HASH_POLICY_RS]	= RSHash,
+	[HASH_POLICY_JS]	= JSHash,
+	[HASH_POLICY_PJW]	= PJWHash,
+	[HASH_POLICY_ELF]	= ELFHash,
+	[HASH_POLICY_BKDR]	= BKDRHash,
+	[HASH_POLICY_SDBM]	= SDBMHash,
+	[HASH_POLICY_DJB]	= DJBHash,
+	[HASH_POLICY_DEK]	= DEKHash,
+	[HASH_POLICY_BP]	= BPHash,
+	[HASH_POLICY_FNV]	= FNVHash,
+	[HASH_POLICY_AP]	= APHash,
+};
+
+/* ######################################################################### */
+
+
+
+
+/* 计算键的哈希值,同时得到键长度 */
+static inline uint32_t _KeyHash(HashKv *ht,const char* k,uint32_t *len)
+{
+	if(ht->policy == HASH_POLICY_WY)
+		return _WyHashStr(k, len);
+	*len = strlen(k);
+	return _hash_funcs[ht->policy]((char*)k,*len);
+}
+
+/* 二进制键,与同样内容的字符串键得到相同的哈希值 */
+static inline uint32_t _KeyHashBin(HashKv *ht,const void* key,uint32_t len)
+{
+	if(ht->policy == HASH_POLICY_WY)
+		return _WyHash(key, len);
+	return _hash_funcs[ht->policy]((char*)key,len);
+}
+
+/* 整数键按本机字节序存放,结果与 _KeyHashBin 相同,但WY算法不需要循环和拷贝 */
+static inline uint32_t _KeyHashU64(HashKv *ht,uint64_t key)
+{
+	if(ht->policy != HASH_POLICY_WY)
+		return _hash_funcs[ht->policy]((char*)&key,sizeof(key));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	key = __builtin_bswap64(key);
+#endif
+	return _WyFinal(WY_S0, key, 0, sizeof(key));
+}
+
+static inline uint32_t _KeyHashU32(HashKv *ht,uint32_t key)
+{
+	if(ht->policy != HASH_POLICY_WY)
+		return _hash_funcs[ht->policy]((char*)&key,sizeof(key));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	key = __builtin_bswap32(key);
+#endif
+	return _WyFinal(WY_S0, key, 0, sizeof(key));
+}
+
+/* 哈希值与长度都相同时才比较键的内容,整数键直接按字比较 */
+static inline int _KeyEqual(HashItem *data_item,uint32_t hash,const char* k,uint32_t k_len)
+{
+	uint64_t	a, b;
+
+	if(data_item->hash != hash || data_item->k_len != k_len)
+		return 0;
+	if(k_len == sizeof(uint64_t)){
+		memcpy(&a, data_item->k, sizeof(a));
+		memcpy(&b, k, sizeof(b));
+		return a == b;
+	}
+	return !memcmp(data_item->k, k, k_len);
+}
+
+/* 对哈希值做二次混合,让低位也足够分散,用于桶/槽定位 */
+static inline uint32_t _HashMix(uint32_t h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+/* 哈希值转换为指纹,避开保留的 HASH_TAG_EMPTY 与 HASH_TAG_TOMB */
+static inline uint32_t _HashTag(uint32_t h)
+{
+	return h > HASH_TAG_TOMB ? h : h + 2;
+}
+
+static inline uint32_t _RoundupPowOfTwo(uint32_t x)
+{
+	uint32_t b = HASH_MIN_LEN;
+	while(b < x && b < 0x80000000U)
+		b <<= 1;
+	return b;
+}
+
+static inline int _IsRehashing(HashKv *ht)
+{
+	return ht->tab[1].len != 0;
+}
+
+static inline HashTabHead* _HashSearch(HashTab *t,uint32_t hash)
+{
+	return t->head + (_HashMix(hash) & (t->len - 1));
+}
+
+static inline HashItem* _TabSearch(HashTabHead *item,uint32_t hash,const char* k,uint32_t k_len)
+{
+	HashItem	*data_item;
+	list_for_each_entry(data_item, &item->head , list)
+	{
+		if(_KeyEqual(data_item,hash,k,k_len))
+			return data_item;
+	}
+	return NULL;
+}
+
+/* 开放寻址: 线性探测,只有指纹相同时才去访问数据项 */
+static HashItem* _OpenSearch(HashTab *t,uint32_t hash,const char* k,uint32_t k_len)
+{
+	uint32_t	mask = t->len - 1;
+	uint32_t	tag = _HashTag(hash);
+	uint32_t	i = _HashMix(hash) & mask;
+	uint32_t	n;
+
+	for(n = 0; n <= mask; n++, i = (i + 1) & mask)
+	{
+		if(t->tag[i] == HASH_TAG_EMPTY)
+			break;
+		if(t->tag[i] == tag && _KeyEqual(t->slot[i], hash, k, k_len))
+			return t->slot[i];
+	}
+	return NULL;
+}
+
+/* 开放寻址: 插入一个确定不存在的数据项,调用前需保证至少有一个空槽 */
+static void _OpenInsert(HashTab *t,uint32_t hash,HashItem *data_item)
+{
+	uint32_t	mask = t->len - 1;
+	uint32_t	i = _HashMix(hash) & mask;
+
+	while(t->tag[i] > HASH_TAG_TOMB)
+		i = (i + 1) & mask;
+	if(t->tag[i] == HASH_TAG_TOMB)
+		t->tomb--;
+	t->tag[i] = _HashTag(hash);
+	t->slot[i] = data_item;
+	t->used++;
+}
+
+/* 开放寻址: 清空一个槽,若后一个槽为空则无需留下墓碑 */
+static void _OpenClear(HashTab *t,uint32_t i)
+{
+	uint32_t	mask = t->len - 1;
+
+	t->slot[i] = NULL;
+	t->used--;
+	if(t->tag[(i + 1) & mask] == HASH_TAG_EMPTY){
+		t->tag[i] = HASH_TAG_EMPTY;
+	}else{
+		t->tag[i] = HASH_TAG_TOMB;
+		t->tomb++;
+	}
+}
+
+/* 开放寻址: 移除数据项,不在此表中返回-1 */
+static int _OpenRemove(HashTab *t,uint32_t hash,HashItem *data_item)
+{
+	uint32_t	mask = t->len - 1;
+	uint32_t	i = _HashMix(hash) & mask;
+	uint32_t	n;
+
+	for(n = 0; n <= mask; n++, i = (i + 1) & mask)
+	{
+		if(t->tag[i] == HASH_TAG_EMPTY)
+			break;
+		if(t->slot[i] == data_item){
+			_OpenClear(t, i);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static int _TabAlloc(HashKv *ht,HashTab *t,uint32_t len)
+{
+	uint32_t	i;
+
+	memset(t, 0, sizeof(HashTab));
+	if(ht->engine == HASH_ENGINE_OPEN)
+	{
+		t->slot = MALLOC(len * (sizeof(HashItem*) + sizeof(uint32_t)));
+		if(!t->slot) return -1;
+		t->tag = (uint32_t*)(t->slot + len);
+		memset(t->tag, 0, len * sizeof(uint32_t));
+	}else{
+		t->head = MALLOC(len * sizeof(HashTabHead));
+		if(!t->head) return -1;
+		for(i = 0; i < len; i++)
+			INIT_LIST_HEAD(&t->head[i].head);
+	}
+	t->len = len;
+	return 0;
+}
+
+static void _TabFree(HashKv *ht,HashTab *t)
+{
+	if(ht->engine == HASH_ENGINE_OPEN)
+		FREE(t->slot);
+	else
+		FREE(t->head);
+	memset(t, 0, sizeof(HashTab));
+}
+
+/* 开始渐进式rehash,之后每次操作只迁移少量桶 */
+static int _TabResize(HashKv *ht,uint32_t len)
+{
+	if(_IsRehashing(ht)) return -1;
+	if(_TabAlloc(ht, &ht->tab[1], len)) return -1;
+	ht->rehash_idx = 0;
+	return 0;
+}
+
+/* 渐进式rehash: 最多迁移 n 个非空桶,迭代期间暂停 */
+static void _RehashStep(HashKv *ht,uint32_t n)
+{
+	HashTab		*from = &ht->tab[0];
+	HashTab		*to = &ht->tab[1];
+	uint32_t	empty_visits = n * 10;	/* 限制单次访问空桶的数量 */
+	HashItem	*data_item;
+	HashItem	*work_item;
+	HashTabHead	*item;
+
+	if(!_IsRehashing(ht) || ht->iterators) return;
+
+	while(n && from->used && ht->rehash_idx < from->len)
+	{
+		if(ht->engine == HASH_ENGINE_OPEN)
+		{
+			if(from->tag[ht->rehash_idx] <= HASH_TAG_TOMB){
+				ht->rehash_idx++;
+				if(--empty_visits == 0) return;
+				continue;
+			}
+			data_item = from->slot[ht->rehash_idx];
+			_OpenInsert(to, data_item->hash, data_item);
+			/* 留下墓碑,保证后面仍在旧表中的数据项探测链不断开 */
+			from->slot[ht->rehash_idx] = NULL;
+			from->tag[ht->rehash_idx] = HASH_TAG_TOMB;
+			from->tomb++;
+			from->used--;
+		}else{
+			item = from->head + ht->rehash_idx;
+			if(list_empty(&item->head)){
+				ht->rehash_idx++;
+				if(--empty_visits == 0) return;
+				continue;
+			}
+			list_for_each_entry_safe(data_item, work_item, &item->head, list)
+			{
+				list_del(&data_item->list);
+				list_add(&data_item->list, &_HashSearch(to, data_item->hash)->head);
+				from->used--;
+				to->used++;
+			}
+		}
+		ht->rehash_idx++;
+		n--;
+	}
+
+	if(from->used == 0 || ht->rehash_idx >= from->len)
+	{
+		/* 迁移完成 */
+		_TabFree(ht, from);
+		*from = *to;
+		memset(to, 0, sizeof(HashTab));
+		ht->rehash_idx = 0;
+	}
+}
+
+static inline int _TabOverload(HashKv *ht,HashTab *t,uint32_t add)
+{
+	if(ht->engine == HASH_ENGINE_OPEN)
+		return (t->used + t->tomb + add) * 4 > t->len * 3;
+	return ht->grow && t->used + add > t->len;
+}
+
+static inline uint32_t _TabFitLen(HashKv *ht,uint32_t used)
+{
+	uint32_t len = _RoundupPowOfTwo(used * 2);
+	return len < ht->min_len ? ht->min_len : len;
+}
+
+/* 为插入一个新数据项预留空间,装载率过高时开始扩容 */
+static int _TabReserve(HashKv *ht)
+{
+	HashTab		*t = &ht->tab[0];
+	uint32_t	pending = 0;
+
+	if(_IsRehashing(ht))
+	{
+		t = &ht->tab[1];
+		/* 开放寻址: 旧表中尚未迁移的数据项最终也要放进新表,一并计入 */
+		if(ht->engine == HASH_ENGINE_OPEN)
+			pending = ht->tab[0].used;
+		if(!_TabOverload(ht, t, pending + 1))
+			return 0;
+		/* 目标表也已经过载,只能先完成本次迁移, 迭代期间无法迁移 */
+		_RehashStep(ht, UINT32_MAX);
+		if(_IsRehashing(ht))
+			goto full;
+		t = &ht->tab[0];
+		pending = 0;
+	}
+	if(!_TabOverload(ht, t, 1))
+		return 0;
+	if(_TabResize(ht, _TabFitLen(ht, t->used)) == 0)
+		return 0;
+full:
+	/* 拉链法总能插入, 开放寻址要保证迁移完旧表后新表仍至少保留一个空槽 */
+	if(ht->engine != HASH_ENGINE_OPEN || t->used + t->tomb + pending + 1 < t->len)
+		return 0;
+	return -1;
+}
+
+/* 删除数据项后检查是否需要缩容 */
+static void _TabShrink(HashKv *ht)
+{
+	HashTab		*t = &ht->tab[0];
+	uint32_t	len;
+
+	if(!ht->shrink || _IsRehashing(ht) || ht->iterators)
+		return;
+	if(t->len <= ht->min_len || t->used * 8 >= t->len)
+		return;
+	len = _TabFitLen(ht, t->used);
+	if(len < t->len)
+		_TabResize(ht, len);
+}
+
+/* 分片表: 用混合后哈希值的高位选择分片,低位留给桶定位 */
+static inline HashKv* _ShardRoute(HashKv *ht,uint32_t hash)
+{
+	if(!ht->shard)
+		return ht;
+	return ht->shard[_HashMix(hash) >> (32 - ht->shard_bits)];
+}
+
+static HashItem* _ItemSearch(HashKv *ht,uint32_t hash,const char* k,uint32_t k_len)
+{
+	HashItem	*data_item;
+	int			i;
+
+	_RehashStep(ht, HASH_REHASH_STEP);
+	for(i = 0; i < 2 && ht->tab[i].len; i++)
+	{
+		if(ht->engine == HASH_ENGINE_OPEN)
+			data_item = _OpenSearch(&ht->tab[i], hash, k, k_len);
+		else
+			data_item = _TabSearch(_HashSearch(&ht->tab[i], hash), hash, k, k_len);
+		if(data_item)
+			return data_item;
+	}
+	return NULL;
+}
+
+static inline int _IsImage(HashKv *ht)
+{
+#if HASH_KV_USE_IMAGE
+	return ht->image != NULL;
+#else
+	(void)ht;
+	return 0;
+#endif
+}
+
+static inline uint64_t _ImageItemSize(uint32_t k_len,uint32_t v_len)
+{
+	return HASH_IMAGE_ALIGN(sizeof(HashImageItem) + (uint64_t)k_len + 1) + HASH_IMAGE_ALIGN(v_len);
+}
+
+static inline const uint8_t* _ImageVal(const HashImageItem *e)
+{
+	return (const uint8_t*)e + HASH_IMAGE_ALIGN(sizeof(HashImageItem) + (uint64_t)e->k_len + 1);
+}
+
+static inline uint64_t _ImageDataStart(uint32_t len)
+{
+	return HASH_IMAGE_ALIGN(sizeof(HashImageHead) + (uint64_t)len * sizeof(uint32_t));
+}
+
+/* 在只读镜像中查找 */
+static const HashImageItem* _ImageSearch(HashKv *ht,uint32_t hash,const char* k,uint32_t k_len)
+{
+#if HASH_KV_USE_IMAGE
+	const HashImageHead	*head = (const HashImageHead*)ht->image;
+	const uint32_t		*bucket = (const uint32_t*)(head + 1);
+	const HashImageItem	*e;
+	uint32_t			off;
+
+	for(off = bucket[_HashMix(hash) & (head->len - 1)]; off; off = e->next)
+	{
+		e = (const HashImageItem*)(ht->image + off);
+		if(e->hash == hash && e->k_len == k_len && !memcmp(e->k, k, k_len))
+			return e;
+	}
+#else
+	(void)ht;
+	(void)hash;
+	(void)k;
+	(void)k_len;
+#endif
+	return NULL;
+}
+
+static int _ImageGetItemData(const HashImageItem *e,void* buf,uint32_t read_size)
+{
+	int rb = read_size > e->v_len ? e->v_len : read_size;
+	memcpy(buf, _ImageVal(e), rb);
+	return rb;
+}
+
+#if HASH_KV_USE_SLAB
+/* 尺寸类: 128字节以内按16字节递增,之后按32字节递增 */
+static inline uint32_t _SlabClass(uint32_t size)
+{
+	if(size <= 128)
+		return size ? (size - 1) >> 4 : 0;
+	return 8 + ((size - 129) >> 5);
+}
+
+static inline uint32_t _SlabClassSize(uint32_t c)
+{
+	return c < 8 ? (c + 1) << 4 : 128 + ((c - 7) << 5);
+}
+#endif
+
+static void* _SlabAlloc(HashKv *ht,uint32_t size)
+{
+	HashSlab	*slab = &ht->slab;
+	void		*p;
+#if HASH_KV_USE_SLAB
+	uint32_t	c, csize;
+
+	if(size <= HASH_SLAB_MAX)
+	{
+		c = _SlabClass(size);
+		csize = _SlabClassSize(c);
+		p = slab->free[c];
+		if(p){
+			slab->free[c] = *(void**)p;
+		}else{
+			if(slab->left < csize)
+			{
+				/* 当前页剩余部分不够用就放弃,计入空闲 */
+				p = MALLOC(HASH_SLAB_PAGE);
+				if(!p) return NULL;
+				*(void**)p = slab->page;
+				slab->page = p;
+				slab->cur = (uint8_t*)p + HASH_SLAB_HEAD;
+				slab->left = HASH_SLAB_PAGE - HASH_SLAB_HEAD;
+				slab->st.slab += HASH_SLAB_PAGE;
+			}
+			p = slab->cur;
+			slab->cur += csize;
+			slab->left -= csize;
+		}
+		slab->st.used += size;
+		slab->st.wasted += csize - size;
+		return p;
+	}
+#endif
+	p = MALLOC(size);
+	if(!p) return NULL;
+	slab->st.used += size;
+	slab->st.large += size;
+	return p;
+}
+
+/* size 必须与申请时一致 */
+static void _SlabFree(HashKv *ht,void *p,uint32_t size)
+{
+	HashSlab	*slab = &ht->slab;
+#if HASH_KV_USE_SLAB
+	uint32_t	c;
+
+	if(size <= HASH_SLAB_MAX)
+	{
+		c = _SlabClass(size);
+		*(void**)p = slab->free[c];
+		slab->free[c] = p;
+		slab->st.used -= size;
+		slab->st.wasted -= _SlabClassSize(c) - size;
+		return;
+	}
+#endif
+	slab->st.used -= size;
+	slab->st.large -= size;
+	FREE(p);
+}
+
+/* 释放所有slab页,调用前所有对象都应已归还 */
+static void _SlabDestroy(HashKv *ht)
+{
+#if HASH_KV_USE_SLAB
+	void		*page;
+
+	while(ht->slab.page)
+	{
+		page = ht->slab.page;
+		ht->slab.page = *(void**)page;
+		FREE(page);
+	}
+#endif
+	memset(&ht->slab, 0, sizeof(ht->slab));
+}
+
+/* 数据项占用的字节数,内联值空间按8字节对齐放在键的后面 */
+static inline uint32_t _ItemSize(uint32_t k_len,uint8_t flags)
+{
+	uint32_t size = offsetof(HashItem, k) + k_len + 1;
+	if(flags & HASH_ITEM_INLINE)
+		size = ((size + 7) & ~7U) + HASH_INLINE_MAX;
+	return size;
+}
+
+static inline void* _ItemInlineVal(HashItem *data_item)
+{
+	return (uint8_t*)data_item + _ItemSize(data_item->k_len, data_item->flags) - HASH_INLINE_MAX;
+}
+
+static inline int _ItemValIsInline(HashItem *data_item)
+{
+	return (data_item->flags & HASH_ITEM_INLINE) && data_item->v == _ItemInlineVal(data_item);
+}
+
+#if HASH_KV_USE_RCU
+static atomic_uint				_rcu_thread_seq;
+static _Thread_local uint32_t	_rcu_thread_id;		/* 0表示尚未分配 */
+
+/* 读者进入临界区,返回所在的计数,退出时交给 _RcuReadUnlock */
+static inline atomic_uint* _RcuReadLock(HashKv *ht)
+{
+	atomic_uint	*cnt;
+	if(!_rcu_thread_id)
+		_rcu_thread_id = atomic_fetch_add(&_rcu_thread_seq, 1) + 1;
+	cnt = &ht->rcu_slot[_rcu_thread_id % HASH_RCU_SLOTS].cnt[atomic_load(&ht->rcu_epoch) & 1];
+	atomic_fetch_add(cnt, 1);
+	return cnt;
+}
+
+static inline void _RcuReadUnlock(atomic_uint *cnt)
+{
+	atomic_fetch_sub_explicit(cnt, 1, memory_order_release);
+}
+
+/* 
+ * 推进宽限期,不阻塞: 翻转两次并等旧计数归零后,所有读者都已看不到此前摘除的对象
+ * 只有持表锁的写者会翻转计数,某个槽还有读者时记下位置,留给之后的写操作继续检查
+ * 返回1表示没有进行中的宽限期
+ */
+static int _RcuGraceAdvance(HashKv *ht)
+{
+	uint32_t	old;
+
+	while(ht->grace_phase)
+	{
+		old = (atomic_load(&ht->rcu_epoch) + 1) & 1;
+		for(; ht->grace_scan < HASH_RCU_SLOTS; ht->grace_scan++)
+		{
+			if(atomic_load(&ht->rcu_slot[ht->grace_scan].cnt[old]))
+				return 0;
+		}
+		ht->grace_scan = 0;
+		if(ht->grace_phase == 2){
+			ht->grace_phase = 0;
+			break;
+		}
+		atomic_fetch_add(&ht->rcu_epoch, 1);
+		ht->grace_phase = 2;
+	}
+	return 1;
+}
+
+static inline HashRcuVal* _RcuVal(void *v)
+{
+	return (HashRcuVal*)((uint8_t*)v - offsetof(HashRcuVal, data));
+}
+#endif
+
+static void _FreeItem(HashKv *ht,HashItem *data_item);
+
+#if HASH_KV_USE_RCU
+static void _RcuFreeList(HashKv *ht,HashItem *data_item,HashRcuVal *rv)
+{
+	HashItem	*next_item;
+	HashRcuVal	*next_rv;
+
+	for(; data_item; data_item = next_item)
+	{
+		next_item = (HashItem*)data_item->list.prev;
+		_FreeItem(ht, data_item);
+	}
+	for(; rv; rv = next_rv)
+	{
+		next_rv = rv->next;
+		_SlabFree(ht, rv, sizeof(HashRcuVal) + rv->len);
+	}
+}
+#endif
+
+/* 
+ * 回收已经摘除的对象,写操作中调用,不会为等待读者而阻塞:
+ * 上一批的宽限期结束后才释放它,再把攒够的新一批交给下一个宽限期
+ * wait为0时直接释放全部,调用者需保证已经没有读者
+ */
+static void _RcuReclaim(HashKv *ht,int wait)
+{
+#if HASH_KV_USE_RCU
+	if(!wait)
+	{
+		_RcuFreeList(ht, ht->grace_item, ht->grace_val);
+		_RcuFreeList(ht, ht->retire_item, ht->retire_val);
+		ht->grace_item = ht->retire_item = NULL;
+		ht->grace_val = ht->retire_val = NULL;
+		ht->retire_num = 0;
+		ht->grace_phase = 0;
+		return;
+	}
+	if(!_RcuGraceAdvance(ht))
+	{
+		/* 读者长时间不离开,待回收对象过多时才让出CPU等它们 */
+		if(ht->retire_num < HASH_RCU_RETIRE_MAX)
+			return;
+		while(!_RcuGraceAdvance(ht))
+			sched_yield();
+	}
+	_RcuFreeList(ht, ht->grace_item, ht->grace_val);
+	ht->grace_item = NULL;
+	ht->grace_val = NULL;
+	if(ht->retire_num < HASH_RCU_RETIRE_BATCH)
+		return;
+	ht->grace_item = ht->retire_item;
+	ht->grace_val = ht->retire_val;
+	ht->retire_item = NULL;
+	ht->retire_val = NULL;
+	ht->retire_num = 0;
+	atomic_fetch_add(&ht->rcu_epoch, 1);
+	ht->grace_phase = 1;
+	ht->grace_scan = 0;
+#else
+	(void)ht;
+	(void)wait;
+#endif
+}
+
+/* 读多写少模式下,摘除的对象要等所有读者离开后才能释放 */
+static void _RcuRetire(HashKv *ht,HashItem *data_item,void *v)
+{
+#if HASH_KV_USE_RCU
+	HashRcuVal	*rv;
+	if(data_item){
+		data_item->list.prev = (struct list_head*)ht->retire_item;
+		ht->retire_item = data_item;
+	}
+	if(v){
+		rv = _RcuVal(v);
+		rv->next = ht->retire_val;
+		ht->retire_val = rv;
+	}
+	/* 有进行中的宽限期时每次写都顺带推进一步 */
+	if(++ht->retire_num >= HASH_RCU_RETIRE_BATCH || ht->grace_phase)
+		_RcuReclaim(ht, 1);
+#else
+	(void)ht;
+	(void)data_item;
+	(void)v;
+#endif
+}
+
+#if HASH_KV_USE_RCU
+/* 读多写少模式下的无锁查找,调用者需处于读临界区 */
+static HashItem* _RcuSearch(HashTab *t,uint32_t hash,const char* k,uint32_t k_len)
+{
+	struct list_head	*head = &_HashSearch(t, hash)->head;
+	struct list_head	*pos;
+	HashItem			*data_item;
+
+	for(pos = HASH_READ_ONCE(head->next); pos != head; pos = HASH_READ_ONCE(pos->next))
+	{
+		atomic_thread_fence(memory_order_acquire);
+		data_item = list_entry(pos, HashItem, list);
+		if(_KeyEqual(data_item, hash, k, k_len))
+			return data_item;
+	}
+	return NULL;
+}
+#endif
+
+/* 将新的数据项挂入哈希表, rehash期间总是插入新表 */
+static int _ItemLink(HashKv *ht,uint32_t hash,HashItem *data_item)
+{
+	HashTab		*t;
+	HashTabHead	*item;
+
+	if(_TabReserve(ht))
+		return -1;
+	t = &ht->tab[_IsRehashing(ht) ? 1 : 0];
+	if(ht->engine == HASH_ENGINE_OPEN){
+		_OpenInsert(t, hash, data_item);
+		return 0;
+	}
+	item = _HashSearch(t, hash);
+#if HASH_KV_USE_RCU
+	if(ht->rcu)
+	{
+		/* 数据项初始化完成后才对读者可见 */
+		data_item->list.next = item->head.next;
+		data_item->list.prev = &item->head;
+		atomic_thread_fence(memory_order_release);
+		HASH_WRITE_ONCE(item->head.next, &data_item->list);
+		data_item->list.next->prev = &data_item->list;
+		t->used++;
+		return 0;
+	}
+#endif
+	list_add(&data_item->list, &item->head);
+	t->used++;
+	return 0;
+}
+
+/* 将数据项从哈希表中摘除 */
+static void _ItemUnlink(HashKv *ht,HashItem *data_item)
+{
+	uint32_t	hash = data_item->hash;
+	HashTab		*t = &ht->tab[0];
+
+	if(ht->engine == HASH_ENGINE_OPEN)
+	{
+		if(_OpenRemove(t, hash, data_item) && _IsRehashing(ht))
+			_OpenRemove(&ht->tab[1], hash, data_item);
+		return;
+	}
+	/* 旧表中 rehash_idx 之前的桶已经迁移到新表 */
+	if(_IsRehashing(ht) && (_HashMix(hash) & (t->len - 1)) < ht->rehash_idx)
+		t = &ht->tab[1];
+	t->used--;
+#if HASH_KV_USE_RCU
+	if(ht->rcu)
+	{
+		/* 保留next,正在此数据项上的读者仍能继续向后遍历 */
+		data_item->list.next->prev = data_item->list.prev;
+		HASH_WRITE_ONCE(data_item->list.prev->next, data_item->list.next);
+		return;
+	}
+#endif
+	list_del(&data_item->list);
+}
+
+static void* _ValAlloc(HashKv *ht,uint32_t len)
+{
+	HashRcuVal	*rv;
+
+	if(!ht->rcu)
+		return _SlabAlloc(ht, len);
+	rv = _SlabAlloc(ht, sizeof(HashRcuVal) + len);
+	if(!rv) return NULL;
+	rv->len = len;
+	return rv->data;
+}
+
+/* len 为值的长度,读多写少模式下以版本头中记录的长度为准 */
+static void _ValFree(HashKv *ht,void *v,uint32_t len)
+{
+#if HASH_KV_USE_RCU
+	if(ht->rcu){
+		_SlabFree(ht, _RcuVal(v), sizeof(HashRcuVal) + _RcuVal(v)->len);
+		return;
+	}
+#endif
+	_SlabFree(ht, v, len);
+}
+
+static HashItem* _NewItem(HashKv *ht,uint32_t hash,const char* k,uint32_t k_len,
+				const void* data,uint32_t data_len)
+{
+	HashItem	*data_item;
+	uint8_t		flags = 0;
+
+	/* 读多写少模式下值需要单独发布与回收,不能内联 */
+	if(!ht->rcu && data_len <= HASH_INLINE_MAX)
+		flags = HASH_ITEM_INLINE;
+	data_item = _SlabAlloc(ht, _ItemSize(k_len, flags));
+	if(!data_item)
+		return NULL;
+	data_item->flags = flags;
+	data_item->k_len = k_len;
+	if(flags & HASH_ITEM_INLINE){
+		data_item->v = _ItemInlineVal(data_item);
+		ht->slab.st.inline_val++;
+	}else{
+		data_item->v = _ValAlloc(ht, data_len);
+		if(!data_item->v){
+			_SlabFree(ht, data_item, _ItemSize(k_len, flags));
+			return NULL;
+		}
+	}
+	if(data)
+		memcpy(data_item->v,data,data_len);
+	else
+		memset(data_item->v,0,data_len);
+	data_item->count = 0;
+	data_item->views = 0;
+	data_item->watch = 0;
+	data_item->expire = 0;
+	data_item->ref = 1;
+	data_item->v_len = data_len;
+	data_item->hash = hash;
+	memcpy(data_item->k,k,k_len);
+	data_item->k[k_len] = '\0';
+	return data_item;
+}
+
+static void _FreeItem(HashKv *ht,HashItem *data_item)
+{
+	if(_ItemValIsInline(data_item))
+		ht->slab.st.inline_val--;
+	else
+		_ValFree(ht, data_item->v, data_item->v_len);
+	_SlabFree(ht, data_item, _ItemSize(data_item->k_len, data_item->flags));
+}
+
+/* 整体:返回值为成功字节数 */
+static int _SetItemData(HashKv *ht,HashItem *data_item,const void* data,uint32_t data_len)
+{
+	void *v = NULL;
+	void *old_v = data_item->v;
+	/* 存在只读视图时只允许原地覆盖 */
+	if(data_item->views && (ht->rcu || data_item->v_len != data_len))
+		return -3;
+	if(data_item->v_len == data_len && !ht->rcu)
+	{
+		memcpy(data_item->v,data,data_len);
+		return (int)data_len;
+	}
+	if((data_item->flags & HASH_ITEM_INLINE) && data_len <= HASH_INLINE_MAX)
+	{
+		/* 长度变化但仍放得进内联空间 */
+		if(!_ItemValIsInline(data_item)){
+			_ValFree(ht, old_v, data_item->v_len);
+			data_item->v = _ItemInlineVal(data_item);
+			ht->slab.st.inline_val++;
+		}
+		memcpy(data_item->v,data,data_len);
+		data_item->v_len = data_len;
+		return (int)data_len;
+	}
+	/* 读多写少模式下总是发布新版本,读者不会看到写了一半的值 */
+	v = _ValAlloc(ht, data_len);
+	if(!v)
+		return -1;
+	memcpy(v,data,data_len);
+#if HASH_KV_USE_RCU
+	if(ht->rcu){
+		atomic_thread_fence(memory_order_release);
+		HASH_WRITE_ONCE(data_item->v, v);
+		data_item->v_len = data_len;
+		_RcuRetire(ht, NULL, old_v);
+		return (int)data_len;
+	}
+#endif
+	if(_ItemValIsInline(data_item))
+		ht->slab.st.inline_val--;
+	else
+		_ValFree(ht, old_v, data_item->v_len);
+	data_item->v = v;
+	data_item->v_len = data_len;
+	return (int)data_len;
+}
+
+/* 整体:返回值为成功字节数 */
+static int _GetItemData(HashItem *data_item,void* buf,uint32_t read_size)
+{
+	int rb = read_size > data_item->v_len ? data_item->v_len : read_size;
+	memcpy(buf, ((uint8_t*)data_item->v),rb);
+	return rb;
+}
+
+#if 0
+/* 分段:返回值为成功字节数 */
+static int _SetItemOffsetData(HashItem *data_item,const void* data,
+				uint32_t data_len,uint32_t offset)
+{
+	int wb = data_item->v_len - offset;	/* 可写空间 */
+	if(wb <= 0) return 0;
+	wb = wb > data_len? data_len : wb;
+	memcpy(((uint8_t*)data_item->v)+offset,data,wb);
+	return wb;
+}
+/* 分段:返回值为成功字节数 */
+static int _GetItemOffsetData(HashItem *data_item, void* buf,
+	uint32_t read_len,uint32_t offset)
+{
+	int rb = data_item->v_len - offset;	/* 可读数量 */
+	if(rb <= 0) return 0;
+	rb = rb > read_len? read_len : rb;	
+	memcpy(buf, ((uint8_t*)data_item->v)+offset,rb);
+	return rb;
+}
+#endif
+
+/* 
+ * 写者在持有分片锁时放入事件,同一时刻只有一个写者,唯一的消费者无锁取出,
+ * 正好满足pfifo单生产者单消费者的要求
+ * 合并: 数据项记录入队时的批次号,批次号未变说明事件还没被取走,不再重复入队;
+ * 消费者先取走一批再推进批次号,之后才处理,所以跳过的写入一定能被读到
+ */
+#if HASH_KV_USE_WATCH
+static int _WatchMatch(HashWatch *w,const char* k,uint32_t k_len)
+{
+	HashWatchKey	*e;
+	uint32_t		i;
+
+	for(i = 0; i < w->num; i++)
+	{
+		e = &w->key[i];
+		if((e->exact ? e->len == k_len : e->len <= k_len) && !memcmp(e->key, k, e->len))
+			return 1;
+	}
+	return 0;
+}
+#endif
+
+static void _WatchNotify(HashKv *ht,HashItem *data_item,enum HashWatchEvent ev)
+{
+#if HASH_KV_USE_WATCH
+	HashWatchQueue	*q;
+	uint8_t			rec[1 + HASH_WATCH_KEY_MAX];
+	uint32_t		gen;
+
+	if(!ht->watch || !_WatchMatch(ht->watch, data_item->k, data_item->k_len))
+		return;
+	q = &ht->watch->q[ht->shard_id];
+	gen = atomic_load(&q->gen);
+	if(ev == HASH_WATCH_SET && data_item->watch == gen)
+		return;
+	if(data_item->k_len > HASH_WATCH_KEY_MAX){
+		atomic_store(&q->overflow, 1);
+		return;
+	}
+	rec[0] = (uint8_t)ev;
+	memcpy(rec + 1, data_item->k, data_item->k_len);
+	if(pfifo_in(&q->fifo, rec, 1 + data_item->k_len) == 0){
+		atomic_store(&q->overflow, 1);	/* 队列满,丢弃并通知消费者重新读取 */
+		return;
+	}
+	data_item->watch = ev == HASH_WATCH_SET ? gen : 0;
+#else
+	(void)ht;
+	(void)data_item;
+	(void)ev;
+#endif
+}
+
+static inline void _DelItemData(HashKv *ht,HashItem *data_item)
+{
+	_WatchNotify(ht, data_item, HASH_WATCH_DEL);
+	_ItemUnlink(ht, data_item);
+	if(ht->rcu)
+		_RcuRetire(ht, data_item, NULL);
+	else
+		_FreeItem(ht, data_item);
+	_TabShrink(ht);
+}
+
+/* ############################## 缓存淘汰 ############################# */
+
+static inline int _ItemPinned(HashItem *data_item)
+{
+	return data_item->count || data_item->views;
+}
+
+/* 回绕安全的过期判断,TTL不能超过2^31毫秒 */
+static inline int _ItemExpired(HashItem *data_item,uint32_t now)
+{
+	uint32_t expire = HASH_READ_ONCE(data_item->expire);
+	return expire && (int32_t)(now - expire) >= 0;
+}
+
+static inline void _ItemSetTTL(HashItem *data_item,uint32_t ttl)
+{
+	uint32_t expire = ttl ? GET_TICK() + ttl : 0;
+	HASH_WRITE_ONCE(data_item->expire, ttl && !expire ? 1 : expire);
+}
+
+static inline void _ItemTouch(HashItem *data_item)
+{
+	if(!HASH_READ_ONCE(data_item->ref))
+		HASH_WRITE_ONCE(data_item->ref, 1);
+}
+
+/* 
+ * 查找未过期的数据项,已过期且未被引用的顺便删除
+ * for_write 为1时,已过期但仍被引用的数据项会被复活交给调用者覆盖,
+ * 否则视为不存在
+ */
+static HashItem* _ItemSearchLive(HashKv *ht,uint32_t hash,const char* k,uint32_t k_len,int for_write)
+{
+	HashItem	*data_item;
+
+	data_item = _ItemSearch(ht, hash, k, k_len);
+	if(!data_item || !_ItemExpired(data_item, GET_TICK()))
+		return data_item;
+	if(!_ItemPinned(data_item)){
+		_DelItemData(ht, data_item);
+		ht->cst.expired++;
+		return NULL;
+	}
+	if(!for_write)
+		return NULL;
+	data_item->expire = 0;
+	return data_item;
+}
+
+/* 读操作的查找: 同时记录命中率并设置访问位 */
+static HashItem* _ItemLookup(HashKv *ht,uint32_t hash,const char* k,uint32_t k_len)
+{
+	HashItem	*data_item;
+
+	data_item = _ItemSearchLive(ht, hash, k, k_len, 0);
+	if(data_item){
+		ht->cst.hit++;
+		_ItemTouch(data_item);
+	}else{
+		ht->cst.miss++;
+	}
+	return data_item;
+}
+
+/* CLOCK: 每次扫描一个桶,扫到时清除访问位,访问位已为0且未被引用的数据项被淘汰 */
+static int _ClockScanBucket(HashKv *ht,HashTab *t,uint32_t i)
+{
+	HashItem	*data_item;
+	HashItem	*work_item;
+
+	if(ht->engine == HASH_ENGINE_OPEN)
+	{
+		if(t->tag[i] <= HASH_TAG_TOMB)
+			return 0;
+		data_item = t->slot[i];
+		if(_ItemPinned(data_item))
+			return 0;
+		if(data_item->ref){
+			HASH_WRITE_ONCE(data_item->ref, 0);
+			return 0;
+		}
+		_DelItemData(ht, data_item);
+		return 1;
+	}
+	list_for_each_entry_safe(data_item, work_item, &t->head[i].head, list)
+	{
+		if(_ItemPinned(data_item))
+			continue;
+		if(data_item->ref){
+			HASH_WRITE_ONCE(data_item->ref, 0);
+			continue;
+		}
+		_DelItemData(ht, data_item);
+		return 1;
+	}
+	return 0;
+}
+
+/* 淘汰数据项直到内存回到上限以内,指针最多绕表两圈 */
+static void _CacheTrim(HashKv *ht)
+{
+	HashTab		*t;
+	uint32_t	limit;
+
+	if(!ht->mem_budget || ht->slab.st.used <= ht->mem_budget)
+		return;
+	limit = (ht->tab[0].len + ht->tab[1].len) * 2;
+	while(limit-- && ht->slab.st.used > ht->mem_budget)
+	{
+		if(ht->clock_tab && !_IsRehashing(ht))
+			ht->clock_tab = 0;
+		t = &ht->tab[ht->clock_tab];
+		if(ht->clock_idx >= t->len)
+		{
+			ht->clock_idx = 0;
+			ht->clock_tab = _IsRehashing(ht) ? !ht->clock_tab : 0;
+			continue;
+		}
+		/* 淘汰后仍停留在本桶,桶中可能还有可淘汰的数据项 */
+		if(_ClockScanBucket(ht, t, ht->clock_idx))
+			ht->cst.evicted++;
+		else
+			ht->clock_idx++;
+	}
+}
+
+/* 写入后检查内存上限,刚写入的数据项不会被淘汰 */
+static inline void _CacheTrimAfterWrite(HashKv *ht,HashItem *data_item)
+{
+	if(!ht->mem_budget)
+		return;
+	data_item->count++;
+	_CacheTrim(ht);
+	data_item->count--;
+}
+
+/* 过期清理: 扫描 n 个桶,返回删除的数量 */
+static uint32_t _CacheSweep(HashKv *ht,uint32_t n)
+{
+	HashTab		*t;
+	HashItem	*data_item;
+	HashItem	*work_item;
+	uint32_t	now = GET_TICK();
+	uint32_t	removed = 0;
+	uint32_t	i;
+
+	while(n--)
+	{
+		if(ht->sweep_tab && !_IsRehashing(ht))
+			ht->sweep_tab = 0;
+		t = &ht->tab[ht->sweep_tab];
+		if(ht->sweep_idx >= t->len)
+		{
+			ht->sweep_idx = 0;
+			ht->sweep_tab = _IsRehashing(ht) ? !ht->sweep_tab : 0;
+			continue;
+		}
+		i = ht->sweep_idx++;
+		if(ht->engine == HASH_ENGINE_OPEN)
+		{
+			if(t->tag[i] <= HASH_TAG_TOMB)
+				continue;
+			data_item = t->slot[i];
+			if(!_ItemPinned(data_item) && _ItemExpired(data_item, now)){
+				_DelItemData(ht, data_item);
+				removed++;
+			}
+			continue;
+		}
+		list_for_each_entry_safe(data_item, work_item, &t->head[i].head, list)
+		{
+			if(!_ItemPinned(data_item) && _ItemExpired(data_item, now)){
+				_DelItemData(ht, data_item);
+				removed++;
+			}
+		}
+	}
+	ht->cst.expired += removed;
+	return removed;
+}
+
+static inline int _MutexLock(HashKv *ht)
+{
+	if(ht->shard_lock)
+		return ht->shard_lock(ht->shard_id);
+	if(ht->lock) 
+		return ht->lock();
+	return 0;
+}
+
+static inline void _MutexUnLock(HashKv *ht)
+{
+	if(ht->shard_unlock)
+		ht->shard_unlock(ht->shard_id);
+	else if(ht->unlock) 
+		ht->unlock();
+}
+
+/* 依次锁住所有分片,得到一致的快照 */
+static int _LockAll(HashKv *obj)
+{
+	uint32_t	i;
+
+	if(!obj->shard)
+		return _MutexLock(obj);
+	for(i = 0; i < (1U << obj->shard_bits); i++)
+	{
+		if(_MutexLock(obj->shard[i])){
+			while(i--)
+				_MutexUnLock(obj->shard[i]);
+			return -2;
+		}
+	}
+	return 0;
+}
+
+static void _UnlockAll(HashKv *obj)
+{
+	uint32_t	i;
+
+	if(!obj->shard){
+		_MutexUnLock(obj);
+		return;
+	}
+	for(i = (1U << obj->shard_bits); i--; )
+		_MutexUnLock(obj->shard[i]);
+}
+
+/* 以下几个函数调用前需已持有表锁 */
+static int _SetDataLocked(HashKv *obj,uint32_t hash,const char* k,uint32_t k_len,
+				const void* data,uint32_t data_len)
+{
+	HashItem	*data_item;
+	int			ret;
+
+	data_item = _ItemSearchLive(obj,hash,k,k_len,1);
+	if(data_item)
+	{
+		ret = _SetItemData(obj, data_item, data, data_len);
+		if(ret >= 0){
+			_WatchNotify(obj, data_item, HASH_WATCH_SET);
+			_CacheTrimAfterWrite(obj, data_item);
+		}
+		return ret;
+	}
+
+	/* 不存在的项,新建 */
+	data_item = _NewItem(obj,hash,k,k_len,data,data_len);
+	if(!data_item)
+		return -1;
+	if(_ItemLink(obj,hash,data_item)){
+		_FreeItem(obj,data_item);
+		return -1;
+	}
+	_WatchNotify(obj, data_item, HASH_WATCH_SET);
+	_CacheTrimAfterWrite(obj, data_item);
+	return data_len;
+}
+
+static int _DelKeyLocked(HashKv *obj,uint32_t hash,const char* k,uint32_t k_len)
+{
+	HashItem	*data_item;
+
+	data_item = _ItemSearch(obj,hash,k,k_len);
+	if(!data_item || data_item->count)
+		return -1;
+	_DelItemData(obj,data_item);
+	return 0;
+}
+
+const char* hash_BlobGetKey(HashBlob_t *b)
+{
+	HashBlob *hb = (HashBlob*)b;
+	if(!b) return NULL;
+	if(hb->ht && _IsImage(hb->ht))
+		return ((const HashImageItem*)hb->data_item)->k;
+    return hb->data_item->k;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_BlobGetKeyBin
+ 功能描述  : 
+ 	获取二进制键及其长度,键后面总有一个0,但键本身也可能包含0
+  参数：
+ 	b			由hash_AcquireBlob生成
+ 	key_len		输出键长度
+  返回值：
+ 	成功返回键,失败返回NULL
+*****************************************************************************/
+const void* hash_BlobGetKeyBin(HashBlob_t *b,uint32_t *key_len)
+{
+	HashBlob *hb = (HashBlob*)b;
+	if(!b || !key_len || !hb->data_item || !hb->ht) return NULL;
+	if(_IsImage(hb->ht)){
+		*key_len = ((const HashImageItem*)hb->data_item)->k_len;
+		return ((const HashImageItem*)hb->data_item)->k;
+	}
+	*key_len = hb->data_item->k_len;
+	return hb->data_item->k;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_BlobSetData
+ 功能描述  : 
+ 	使用特殊方式设置数据
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	k			键值
+ 	data		数据缓冲区
+ 	data_len	数据大小
+  返回值：
+ 	成功返回写入的字节数,失败返回负数
+*****************************************************************************/
+int hash_BlobSetData(HashBlob_t *b,const void* data,uint32_t data_len)
+{
+	HashBlob	*hb = (HashBlob*)b;
+	int ret;
+
+	if(!b) return -1;
+	if(!hb->data_item || !hb->ht || _IsImage(hb->ht)) return -1;
+
+	if(_MutexLock(hb->ht)) return -2;
+	ret = _SetItemData(hb->ht,hb->data_item,data,data_len);
+	if(ret >= 0){
+		_WatchNotify(hb->ht, hb->data_item, HASH_WATCH_SET);
+		_CacheTrim(hb->ht);
+	}
+	_MutexUnLock(hb->ht);
+	return ret;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_BlobGetData
+ 功能描述  : 
+ 	使用特殊方式读数据
+  参数：
+ 	b 			由hash_AcquireBlob生成
+ 	buf			数据缓冲区
+ 	read_len		数据大小
+  返回值：
+ 	成功返回获取的字节数,失败返回负数
+*****************************************************************************/
+int hash_BlobGetData(HashBlob_t * b, void * buf, uint32_t read_len)
+{
+	HashBlob	*hb = (HashBlob*)b;
+	int ret;
+	if(!b) return -1;
+	if(!hb->data_item || !hb->ht ) return -1;
+	if(_IsImage(hb->ht))
+		return _ImageGetItemData((const HashImageItem*)hb->data_item,buf,read_len);
+	if(_MutexLock(hb->ht)) return -2;
+	ret = _GetItemData(hb->data_item,buf,read_len);
+	_MutexUnLock(hb->ht);
+	return ret;
+}
+
+
+/*****************************************************************************
+ 函 数 名  : hash_BlobGetView
+ 功能描述  : 
+ 	获取值的只读视图,不发生拷贝
+ 	视图存在期间值不会被释放或搬家: 改变长度的写入返回错误,
+ 	读多写少模式下所有写入都返回错误,相同长度的写入会原地覆盖
+ 	需要在 hash_ReleaseBlob 之前调用 hash_BlobPutView
+  参数：
+ 	b 			由hash_AcquireBlob生成
+ 	data		输出值的地址
+ 	len			输出值的长度
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_BlobGetView(HashBlob_t *b,const void **data,uint32_t *len)
+{
+	HashBlob	*hb = (HashBlob*)b;
+	const HashImageItem *e;
+	if(!b || !data || !len) return -1;
+	if(!hb->data_item || !hb->ht ) return -1;
+	if(_IsImage(hb->ht)){
+		e = (const HashImageItem*)hb->data_item;
+		*data = _ImageVal(e);
+		*len = e->v_len;
+		return 0;
+	}
+	if(_MutexLock(hb->ht)) return -2;
+	hb->data_item->views++;
+	*data = hb->data_item->v;
+	*len = hb->data_item->v_len;
+	_MutexUnLock(hb->ht);
+	return 0;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_BlobPutView
+ 功能描述  : 
+ 	归还由 hash_BlobGetView 获取的视图
+  参数：
+ 	b 			由hash_AcquireBlob生成
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_BlobPutView(HashBlob_t *b)
+{
+	HashBlob	*hb = (HashBlob*)b;
+	if(!b) return -1;
+	if(!hb->data_item || !hb->ht ) return -1;
+	if(_IsImage(hb->ht)) return 0;
+	if(_MutexLock(hb->ht)) return -2;
+	if(hb->data_item->views > 0)
+		hb->data_item->views--;
+	_MutexUnLock(hb->ht);
+	return 0;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_BlobMutate
+ 功能描述  : 
+ 	在表锁内原地修改值,mutator 拿到可写的地址,不发生拷贝,
+ 	mutator 返回后地址即失效,其中不能再调用本表的接口
+ 	读多写少模式下读者不加锁,先复制出新版本交给 mutator,
+ 	mutator 返回非负数时才发布
+  参数：
+ 	b 			由hash_AcquireBlob生成
+ 	mutator		修改函数,data/len 为值的地址与长度
+ 	param		传给 mutator 的参数
+  返回值：
+ 	成功返回 mutator 的返回值,失败返回负数
+*****************************************************************************/
+int hash_BlobMutate(HashBlob_t *b,int (*mutator)(void* param,void* data,uint32_t len),void *param)
+{
+	HashBlob	*hb = (HashBlob*)b;
+	HashKv		*ht;
+	HashItem	*data_item;
+	int			ret;
+#if HASH_KV_USE_RCU
+	void		*v, *old_v;
+#endif
+	if(!b || !mutator) return -1;
+	if(!hb->data_item || !hb->ht || _IsImage(hb->ht)) return -1;
+	ht = hb->ht;
+	data_item = hb->data_item;
+	if(_MutexLock(ht)) return -2;
+#if HASH_KV_USE_RCU
+	if(ht->rcu)
+	{
+		if(data_item->views){
+			_MutexUnLock(ht);
+			return -3;
+		}
+		v = _ValAlloc(ht, data_item->v_len);
+		if(!v){
+			_MutexUnLock(ht);
+			return -1;
+		}
+		memcpy(v, data_item->v, data_item->v_len);
+		ret = mutator(param, v, data_item->v_len);
+		if(ret < 0){
+			_ValFree(ht, v, data_item->v_len);
+		}else{
+			old_v = data_item->v;
+			atomic_thread_fence(memory_order_release);
+			HASH_WRITE_ONCE(data_item->v, v);
+			_RcuRetire(ht, NULL, old_v);
+			_WatchNotify(ht, data_item, HASH_WATCH_SET);
+		}
+		_MutexUnLock(ht);
+		return ret;
+	}
+#endif
+	ret = mutator(param, data_item->v, data_item->v_len);
+	if(ret >= 0)
+		_WatchNotify(ht, data_item, HASH_WATCH_SET);
+	_MutexUnLock(ht);
+	return ret;
+}
+
+static int _AcquireBlob(HashKv *obj,HashBlob *hb,uint32_t hash,const char* k,uint32_t k_len)
+{
+	HashItem	*data_item;
+
+	obj = _ShardRoute(obj, hash);
+	if(_IsImage(obj))
+	{
+		/* 镜像不可修改,无需引用计数 */
+		hb->data_item = (HashItem*)_ImageSearch(obj,hash,k,k_len);
+		hb->ht = hb->data_item ? obj : NULL;
+		return hb->data_item ? 0 : -1;
+	}
+	if(_MutexLock(obj)) return -2;
+	data_item = _ItemLookup(obj,hash,k,k_len);
+	
+	if(!data_item){
+		_MutexUnLock(obj);
+		return -1;
+	}
+	hb->data_item = data_item;
+	hb->ht = obj;
+	data_item->count++;
+	_MutexUnLock(obj);
+	return 0;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_AcquireBlob
+ 功能描述  : 
+ 	获取特殊方式对象	HashBlob_t
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	k			键值
+ 	b			输出参数，请到上层实例化
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_AcquireBlob(HashKv_t ht, HashBlob_t *b,char* k)
+{
+	HashKv		*obj = (HashKv*)ht;
+	uint32_t	hash, k_len;
+	if(!obj || !b || !k) return -1;
+	
+	hash = _KeyHash(obj,k,&k_len);
+	return _AcquireBlob(obj, (HashBlob*)b, hash, k, k_len);
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_ReleaseBlob
+ 功能描述  : 
+ 	释放HashBlob_t引用减1
+  参数：
+ 	b			由hash_AcquireBlob生成
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_ReleaseBlob(HashBlob_t *b)
+{
+	HashBlob	*hb = (HashBlob*)b;
+	HashKv 		*ht;
+	if(!b) return -1;
+
+	if(!hb->data_item || !hb->ht ) return 0;
+	ht = hb->ht;
+	if(_IsImage(ht)){
+		hb->data_item = NULL;
+		hb->ht = NULL;
+		return 0;
+	}
+	if(_MutexLock(ht)) return -2;
+	if(hb->data_item->count > 0)
+		hb->data_item->count--;
+	hb->data_item = NULL;
+	hb->ht = NULL;
+	_MutexUnLock(ht);	
+	return 0;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_DelKeyFormBlob
+ 功能描述  : 
+ 	利用Blob删除键值对,只有引用为0时才真正删除
+  参数：
+ 	b			由hash_AcquireBlob生成
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_DelKeyFormBlob(HashBlob_t *b)
+{
+	HashBlob	*hb = (HashBlob*)b;
+	HashKv 		*ht;
+	HashItem	*data_item;
+	if(!b) return -1;
+
+	if(!hb->data_item || !hb->ht || _IsImage(hb->ht)) return -1;
+	ht = hb->ht;
+	data_item = hb->data_item;
+
+	if(_MutexLock(ht)) return -2;
+	if(data_item->views){
+		_MutexUnLock(ht);
+		return -3;
+	}
+	if(data_item->count > 0)
+		data_item->count--;
+	hb->data_item = NULL;
+	hb->ht = NULL;
+	if(data_item->count == 0)
+		_DelItemData(ht,data_item);
+	_MutexUnLock(ht);
+	return 0;
+}
+
+
+
+static int _DelKey(HashKv *obj,uint32_t hash,const char* k,uint32_t k_len)
+{
+	int			ret;
+
+	obj = _ShardRoute(obj, hash);
+	if(_IsImage(obj)) return -1;
+	if(_MutexLock(obj)) return -2;
+	ret = _DelKeyLocked(obj,hash,k,k_len);
+	_MutexUnLock(obj);
+	return ret;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_DelKey
+ 功能描述  : 
+ 	获取值
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	k			键值
+  返回值：
+ 	成功返回0,失败返回-1
+*****************************************************************************/
+int hash_DelKey(HashKv_t ht,const char* k)
+{
+	HashKv		*obj = (HashKv*)ht;
+	uint32_t	hash, k_len;
+	if(!obj || !k) return -1;
+	
+	hash = _KeyHash(obj,k,&k_len);
+	return _DelKey(obj, hash, k, k_len);
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_NewData
+ 功能描述  : 
+ 	新建一个数据项
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	k			键值
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_NewData(HashKv_t ht,const char* k,uint32_t data_len)
+{
+	HashKv		*obj = (HashKv*)ht;
+	HashItem	*data_item;
+	uint32_t	hash, k_len;
+	
+	if(!obj || !k)  return -1;
+	
+	hash = _KeyHash(obj,k,&k_len);
+	obj = _ShardRoute(obj, hash);
+	if(_IsImage(obj)) return -1;
+	if(_MutexLock(obj)) return -2;
+	
+	data_item = _ItemSearchLive(obj,hash,k,k_len,0);
+	if(data_item)
+	{
+		_MutexUnLock(obj);	/* 本来就存在 */
+		return -3;
+	}
+
+	/* 不存在的项,新建 */
+	data_item = _NewItem(obj,hash,k,k_len,NULL,data_len);
+	if(!data_item)
+		goto alloc_di;
+	if(_ItemLink(obj,hash,data_item))
+		goto link_di;
+	_WatchNotify(obj, data_item, HASH_WATCH_SET);
+	_CacheTrimAfterWrite(obj, data_item);
+	_MutexUnLock(obj);
+	
+	return 0;
+link_di:
+	_FreeItem(obj,data_item);
+alloc_di:
+	_MutexUnLock(obj);
+	return -1;
+}
+
+
+static int _SetData(HashKv *obj,uint32_t hash,const char* k,uint32_t k_len,
+				const void* data,uint32_t data_len)
+{
+	int 		ret = 0;
+
+	obj = _ShardRoute(obj, hash);
+	if(_IsImage(obj)) return -1;
+	if(_MutexLock(obj)) return -2;
+	ret = _SetDataLocked(obj,hash,k,k_len,data,data_len);
+	_MutexUnLock(obj);
+	return ret;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_SetData
+ 功能描述  : 
+ 	设置值，对于不存在的值会自动新建
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	k			键值
+ 	data		数据缓冲区 
+ 	data_len	数据大小，必须大于0
+  返回值：
+ 	成功返回设置的字节数,失败返回负数
+*****************************************************************************/
+int hash_SetData(HashKv_t ht,const char* k,const void* data,uint32_t data_len)
+{
+	HashKv		*obj = (HashKv*)ht;
+	uint32_t	hash, k_len;
+	
+	if(!obj || !k || data_len == 0 || !data)  return -1;
+	
+	hash = _KeyHash(obj,k,&k_len);
+	return _SetData(obj, hash, k, k_len, data, data_len);
+}
+
+
+
+
+#if HASH_KV_USE_RCU
+/* 读多写少模式: 值的指针与长度来自同一个版本,调用者需处于读临界区 */
+static int _RcuGetItemData(HashItem *data_item,void* buf,uint32_t read_size)
+{
+	HashRcuVal	*rv;
+	int			rb;
+
+	rv = _RcuVal(HASH_READ_ONCE(data_item->v));
+	atomic_thread_fence(memory_order_acquire);
+	rb = read_size > rv->len ? rv->len : read_size;
+	memcpy(buf, rv->data, rb);
+	return rb;
+}
+#endif
+
+#if HASH_KV_USE_RCU
+/* 读多写少模式下的读查找,过期的数据项视为不存在,留给写者或清理删除 */
+static HashItem* _RcuLookup(HashKv *ht,uint32_t hash,const char* k,uint32_t k_len)
+{
+	HashRcuSlot	*slot = &ht->rcu_slot[_rcu_thread_id % HASH_RCU_SLOTS];
+	HashItem	*data_item;
+
+	data_item = _RcuSearch(&ht->tab[0], hash, k, k_len);
+	if(data_item && _ItemExpired(data_item, GET_TICK()))
+		data_item = NULL;
+	if(data_item){
+		atomic_fetch_add_explicit(&slot->hit, 1, memory_order_relaxed);
+		_ItemTouch(data_item);
+	}else{
+		atomic_fetch_add_explicit(&slot->miss, 1, memory_order_relaxed);
+	}
+	return data_item;
+}
+#endif
+
+/* 读多写少模式: 不加锁读取 */
+static int _RcuGetData(HashKv *obj,uint32_t hash,const char* k,uint32_t k_len,
+				void* buf,uint32_t read_size)
+{
+	int 		ret = -1;
+#if HASH_KV_USE_RCU
+	atomic_uint	*cnt;
+	HashItem	*data_item;
+
+	cnt = _RcuReadLock(obj);
+	data_item = _RcuLookup(obj, hash, k, k_len);
+	if(data_item)
+		ret = _RcuGetItemData(data_item, buf, read_size);
+	_RcuReadUnlock(cnt);
+#else
+	(void)obj;
+	(void)hash;
+	(void)k;
+	(void)k_len;
+	(void)buf;
+	(void)read_size;
+#endif
+	return ret;
+}
+
+static int _GetData(HashKv *obj,uint32_t hash,const char* k,uint32_t k_len,
+				void* buf,uint32_t read_size)
+{
+	const HashImageItem *e;
+	HashItem	*data_item;
+	int 		ret = 0;
+
+	obj = _ShardRoute(obj, hash);
+	if(_IsImage(obj)){
+		e = _ImageSearch(obj, hash, k, k_len);
+		return e ? _ImageGetItemData(e, buf, read_size) : -1;
+	}
+	if(obj->rcu)
+		return _RcuGetData(obj, hash, k, k_len, buf, read_size);
+	if(_MutexLock(obj)) return -1;
+	
+	data_item = _ItemLookup(obj,hash,k,k_len);
+	if(data_item)
+		ret = _GetItemData(data_item, buf, read_size);
+	else
+		ret = -1;
+	
+	_MutexUnLock(obj);
+	return ret;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_GetData
+ 功能描述  : 
+ 	获取值
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	k			键值
+ 	buf			缓冲区
+ 	read_size	要读的大小
+  返回值：
+ 	成功返回读到的字节数,失败返回负数
+*****************************************************************************/
+int hash_GetData(HashKv_t ht,const char* k,void* buf,uint32_t read_size)
+{
+	HashKv		*obj = (HashKv*)ht;
+	uint32_t	hash, k_len;
+	if(!obj || !k) return -1;	
+	hash = _KeyHash(obj,k,&k_len);
+	return _GetData(obj, hash, k, k_len, buf, read_size);
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_KeyHash
+ 功能描述  : 
+ 	按表的哈希算法计算键的哈希值,供 hash_GetDataHashed 使用
+ 	修改哈希算法后之前算出的值作废
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	k			键值
+ 	len			输出键长度,可以为NULL
+  返回值：
+ 	哈希值
+*****************************************************************************/
+uint32_t hash_KeyHash(HashKv_t ht,const char* k,uint32_t *len)
+{
+	HashKv		*obj = (HashKv*)ht;
+	uint32_t	k_len, hash;
+	if(!obj || !k) return 0;
+	hash = _KeyHash(obj,k,&k_len);
+	if(len)
+		*len = k_len;
+	return hash;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_GetDataHashed
+ 功能描述  : 
+ 	用预先算好的哈希值获取值,反复查找固定的键时可省去每次的哈希计算
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	k			键值
+ 	len			键长度,与hash一起由 hash_KeyHash 得到
+ 	hash		键的哈希值
+ 	buf			缓冲区
+ 	read_size	要读的大小
+  返回值：
+ 	成功返回读到的字节数,失败返回负数
+*****************************************************************************/
+int hash_GetDataHashed(HashKv_t ht,const char* k,uint32_t len,uint32_t hash,
+				void* buf,uint32_t read_size)
+{
+	HashKv		*obj = (HashKv*)ht;
+	if(!obj || !k) return -1;
+	return _GetData(obj, hash, k, len, buf, read_size);
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_KeyHashBin
+ 功能描述  : 
+ 	计算二进制键的哈希值,供 hash_GetDataHashed 使用
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	key			键
+ 	key_len		键长度
+  返回值：
+ 	哈希值
+*****************************************************************************/
+uint32_t hash_KeyHashBin(HashKv_t ht,const void* key,uint32_t key_len)
+{
+	HashKv		*obj = (HashKv*)ht;
+	if(!obj || !key) return 0;
+	return _KeyHashBin(obj, key, key_len);
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_SetDataBin
+ 功能描述  : 
+ 	以二进制键设置值,对于不存在的值会自动新建
+ 	键可以包含0,内容与字符串键相同时访问的是同一个键
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	key			键
+ 	key_len		键长度
+ 	data		数据缓冲区 
+ 	data_len	数据大小，必须大于0
+  返回值：
+ 	成功返回设置的字节数,失败返回负数
+*****************************************************************************/
+int hash_SetDataBin(HashKv_t ht,const void* key,uint32_t key_len,const void* data,uint32_t data_len)
+{
+	HashKv		*obj = (HashKv*)ht;
+	if(!obj || !key || data_len == 0 || !data)  return -1;
+	return _SetData(obj, _KeyHashBin(obj, key, key_len), key, key_len, data, data_len);
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_GetDataBin
+ 功能描述  : 
+ 	以二进制键获取值
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	key			键
+ 	key_len		键长度
+ 	buf			缓冲区
+ 	read_size	要读的大小
+  返回值：
+ 	成功返回读到的字节数,失败返回负数
+*****************************************************************************/
+int hash_GetDataBin(HashKv_t ht,const void* key,uint32_t key_len,void* buf,uint32_t read_size)
+{
+	HashKv		*obj = (HashKv*)ht;
+	if(!obj || !key) return -1;
+	return _GetData(obj, _KeyHashBin(obj, key, key_len), key, key_len, buf, read_size);
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_DelKeyBin
+ 功能描述  : 
+ 	以二进制键删除键值对
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	key			键
+ 	key_len		键长度
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_DelKeyBin(HashKv_t ht,const void* key,uint32_t key_len)
+{
+	HashKv		*obj = (HashKv*)ht;
+	if(!obj || !key) return -1;
+	return _DelKey(obj, _KeyHashBin(obj, key, key_len), key, key_len);
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_AcquireBlobBin
+ 功能描述  : 
+ 	以二进制键获取特殊方式对象	HashBlob_t
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	b			输出参数，请到上层实例化
+ 	key			键
+ 	key_len		键长度
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_AcquireBlobBin(HashKv_t ht,HashBlob_t *b,const void* key,uint32_t key_len)
+{
+	HashKv		*obj = (HashKv*)ht;
+	if(!obj || !b || !key) return -1;
+	return _AcquireBlob(obj, (HashBlob*)b, _KeyHashBin(obj, key, key_len), key, key_len);
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_SetDataU32
+ 功能描述  : 
+ 	以4字节整数为键设置值,键按本机字节序存放,
+ 	与 hash_SetDataBin(ht,&key,4,...) 访问的是同一个键
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	key			整数键
+ 	data		数据缓冲区 
+ 	data_len	数据大小，必须大于0
+  返回值：
+ 	成功返回设置的字节数,失败返回负数
+*****************************************************************************/
+int hash_SetDataU32(HashKv_t ht,uint32_t key,const void* data,uint32_t data_len)
+{
+	HashKv		*obj = (HashKv*)ht;
+	if(!obj || data_len == 0 || !data)  return -1;
+	return _SetData(obj, _KeyHashU32(obj, key), (const char*)&key, sizeof(key), data, data_len);
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_GetDataU32
+ 功能描述  : 
+ 	以4字节整数为键获取值
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	key			整数键
+ 	buf			缓冲区
+ 	read_size	要读的大小
+  返回值：
+ 	成功返回读到的字节数,失败返回负数
+*****************************************************************************/
+int hash_GetDataU32(HashKv_t ht,uint32_t key,void* buf,uint32_t read_size)
+{
+	HashKv		*obj = (HashKv*)ht;
+	if(!obj) return -1;
+	return _GetData(obj, _KeyHashU32(obj, key), (const char*)&key, sizeof(key), buf, read_size);
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_DelKeyU32
+ 功能描述  : 
+ 	以4字节整数为键删除键值对
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	key			整数键
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_DelKeyU32(HashKv_t ht,uint32_t key)
+{
+	HashKv		*obj = (HashKv*)ht;
+	if(!obj) return -1;
+	return _DelKey(obj, _KeyHashU32(obj, key), (const char*)&key, sizeof(key));
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_SetDataU64
+ 功能描述  : 
+ 	以8字节整数为键设置值,键按本机字节序存放,
+ 	与 hash_SetDataBin(ht,&key,8,...) 访问的是同一个键
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	key			整数键
+ 	data		数据缓冲区 
+ 	data_len	数据大小，必须大于0
+  返回值：
+ 	成功返回设置的字节数,失败返回负数
+*****************************************************************************/
+int hash_SetDataU64(HashKv_t ht,uint64_t key,const void* data,uint32_t data_len)
+{
+	HashKv		*obj = (HashKv*)ht;
+	if(!obj || data_len == 0 || !data)  return -1;
+	return _SetData(obj, _KeyHashU64(obj, key), (const char*)&key, sizeof(key), data, data_len);
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_GetDataU64
+ 功能描述  : 
+ 	以8字节整数为键获取值
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	key			整数键
+ 	buf			缓冲区
+ 	read_size	要读的大小
+  返回值：
+ 	成功返回读到的字节数,失败返回负数
+*****************************************************************************/
+int hash_GetDataU64(HashKv_t ht,uint64_t key,void* buf,uint32_t read_size)
+{
+	HashKv		*obj = (HashKv*)ht;
+	if(!obj) return -1;
+	return _GetData(obj, _KeyHashU64(obj, key), (const char*)&key, sizeof(key), buf, read_size);
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_DelKeyU64
+ 功能描述  : 
+ 	以8字节整数为键删除键值对
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	key			整数键
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_DelKeyU64(HashKv_t ht,uint64_t key)
+{
+	HashKv		*obj = (HashKv*)ht;
+	if(!obj) return -1;
+	return _DelKey(obj, _KeyHashU64(obj, key), (const char*)&key, sizeof(key));
+}
+
+/* 预取键所在的桶,批量操作中与前面键的查找重叠 */
+static inline void _ItemPrefetch(HashKv *ht,uint32_t hash)
+{
+	HashTab		*t = &ht->tab[0];
+	uint32_t	i = _HashMix(hash) & (t->len - 1);
+
+	if(ht->engine == HASH_ENGINE_OPEN){
+		__builtin_prefetch(&t->tag[i]);
+		__builtin_prefetch(&t->slot[i]);
+	}else{
+		__builtin_prefetch(&t->head[i]);
+	}
+}
+
+static int _BatchCmp(const void *a,const void *b)
+{
+	const HashBatch *x = a, *y = b;
+	if(x->obj->shard_id != y->obj->shard_id)
+		return x->obj->shard_id < y->obj->shard_id ? -1 : 1;
+	return x->idx < y->idx ? -1 : (x->idx > y->idx);
+}
+
+/* 批量操作: 先算出所有键的哈希并按分片分组,每个分片只加一次锁 */
+static int _MultiOp(HashKv *obj,enum HashBatchOp op,uint32_t n,const char **k,
+				void **buf,const void **data,const uint32_t *len,int *status)
+{
+	HashBatch	stack[HASH_BATCH_STACK];
+	HashBatch	*bt = stack;
+	HashBatch	*e;
+	const HashImageItem *img;
+	HashKv		*sh;
+	uint32_t	i, j, m;
+	HashItem	*data_item;
+	int			ok = 0;
+#if HASH_KV_USE_RCU
+	atomic_uint	*cnt;
+#endif
+
+	for(i = 0; i < n; i++)
+		if(!k[i]) return -1;
+	if(n > HASH_BATCH_STACK){
+		bt = MALLOC(n * sizeof(HashBatch));
+		if(!bt) return -1;
+	}
+	for(i = 0; i < n; i++)
+	{
+		bt[i].hash = _KeyHash(obj, k[i], &bt[i].k_len);
+		bt[i].obj = _ShardRoute(obj, bt[i].hash);
+		bt[i].idx = i;
+	}
+	if(obj->shard)
+		qsort(bt, n, sizeof(HashBatch), _BatchCmp);
+
+	for(i = 0; i < n; i = j)
+	{
+		sh = bt[i].obj;
+		for(j = i; j < n && bt[j].obj == sh; j++)
+			;
+		if(_IsImage(sh))
+		{
+			/* 只读镜像不需要加锁,也不能修改 */
+			for(m = i; m < j; m++)
+			{
+				e = &bt[m];
+				img = op == HASH_BATCH_GET ? _ImageSearch(sh, e->hash, k[e->idx], e->k_len) : NULL;
+				status[e->idx] = img ? _ImageGetItemData(img, buf[e->idx], len[e->idx]) : -1;
+				ok += status[e->idx] >= 0;
+			}
+			continue;
+		}
+#if HASH_KV_USE_RCU
+		if(op == HASH_BATCH_GET && sh->rcu)
+		{
+			cnt = _RcuReadLock(sh);
+			for(m = i; m < j; m++)
+			{
+				e = &bt[m];
+				data_item = _RcuLookup(sh, e->hash, k[e->idx], e->k_len);
+				status[e->idx] = data_item ? _RcuGetItemData(data_item, buf[e->idx], len[e->idx]) : -1;
+				ok += status[e->idx] >= 0;
+			}
+			_RcuReadUnlock(cnt);
+			continue;
+		}
+#endif
+		if(_MutexLock(sh))
+		{
+			for(m = i; m < j; m++)
+				status[bt[m].idx] = -2;
+			continue;
+		}
+		for(m = i; m < j && m < i + HASH_BATCH_PREFETCH; m++)
+			_ItemPrefetch(sh, bt[m].hash);
+		for(m = i; m < j; m++)
+		{
+			e = &bt[m];
+			if(m + HASH_BATCH_PREFETCH < j)
+				_ItemPrefetch(sh, bt[m + HASH_BATCH_PREFETCH].hash);
+			switch(op)
+			{
+			case HASH_BATCH_GET:
+				data_item = _ItemLookup(sh, e->hash, k[e->idx], e->k_len);
+				status[e->idx] = data_item ? _GetItemData(data_item, buf[e->idx], len[e->idx]) : -1;
+				break;
+			case HASH_BATCH_SET:
+				if(!data[e->idx] || len[e->idx] == 0)
+					status[e->idx] = -1;
+				else
+					status[e->idx] = _SetDataLocked(sh, e->hash, k[e->idx], e->k_len,
+										data[e->idx], len[e->idx]);
+				break;
+			case HASH_BATCH_DEL:
+				status[e->idx] = _DelKeyLocked(sh, e->hash, k[e->idx], e->k_len);
+				break;
+			}
+			ok += status[e->idx] >= 0;
+		}
+		_MutexUnLock(sh);
+	}
+	if(bt != stack)
+		FREE(bt);
+	return ok;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_MultiGet
+ 功能描述  : 
+ 	批量获取值,所有键先统一计算哈希,再按分片分组,每个分片只加一次锁
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	n			键的数量
+ 	k			键值数组
+ 	buf			缓冲区数组
+ 	read_size	要读的大小数组
+ 	status		输出每个键的结果,与 hash_GetData 的返回值相同
+  返回值：
+ 	成功返回成功的键数量,参数错误返回负数
+*****************************************************************************/
+int hash_MultiGet(HashKv_t ht,uint32_t n,const char **k,void **buf,
+				const uint32_t *read_size,int *status)
+{
+	HashKv		*obj = (HashKv*)ht;
+	if(!obj || !k || !buf || !read_size || !status) return -1;
+	return _MultiOp(obj, HASH_BATCH_GET, n, k, buf, NULL, read_size, status);
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_MultiSet
+ 功能描述  : 
+ 	批量设置值,不存在的键自动新建
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	n			键的数量
+ 	k			键值数组
+ 	data		数据缓冲区数组
+ 	data_len	数据大小数组,必须大于0
+ 	status		输出每个键的结果,与 hash_SetData 的返回值相同
+  返回值：
+ 	成功返回成功的键数量,参数错误返回负数
+*****************************************************************************/
+int hash_MultiSet(HashKv_t ht,uint32_t n,const char **k,const void **data,
+				const uint32_t *data_len,int *status)
+{
+	HashKv		*obj = (HashKv*)ht;
+	if(!obj || !k || !data || !data_len || !status) return -1;
+	return _MultiOp(obj, HASH_BATCH_SET, n, k, NULL, data, data_len, status);
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_MultiDel
+ 功能描述  : 
+ 	批量删除键值对
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	n			键的数量
+ 	k			键值数组
+ 	status		输出每个键的结果,与 hash_DelKey 的返回值相同
+  返回值：
+ 	成功返回成功的键数量,参数错误返回负数
+*****************************************************************************/
+int hash_MultiDel(HashKv_t ht,uint32_t n,const char **k,int *status)
+{
+	HashKv		*obj = (HashKv*)ht;
+	if(!obj || !k || !status) return -1;
+	return _MultiOp(obj, HASH_BATCH_DEL, n, k, NULL, NULL, NULL, status);
+}
+
+
+
+/* 迭代时将数据项交给处理函数,处理函数未释放Blob时由这里去掉引用 */
+static int _IterProcess(HashKv *obj,HashItem *data_item,
+	enum HashIterState (*processor)(void* param,HashBlob_t* ),void *param,
+	enum HashIterState *state)
+{
+	HashBlob	Blob;
+
+	Blob.data_item = data_item;
+	Blob.ht = obj;
+	data_item->count++;
+
+	_MutexUnLock(obj);	/* 释放锁 */
+	*state = processor(param,(HashBlob_t*)&Blob);
+	if(_MutexLock(obj))
+	{
+		if(Blob.data_item && Blob.data_item->count > 0)
+			Blob.data_item->count--; /* 即使获取不到锁也要强行去掉引用 */
+		return -2;
+	}
+	if(Blob.data_item && Blob.data_item->count > 0)
+		Blob.data_item->count--;
+	return 0;
+}
+
+/* 只读镜像的迭代,不需要加锁 */
+static int _ImageIteration(HashKv *obj,
+	enum HashIterState (*processor)(void* param,HashBlob_t* ),void *param,
+	enum HashIterState *pstate)
+{
+#if HASH_KV_USE_IMAGE
+	const HashImageHead	*head = (const HashImageHead*)obj->image;
+	const uint32_t		*bucket = (const uint32_t*)(head + 1);
+	const HashImageItem	*e;
+	HashBlob			Blob;
+	uint32_t			i, off;
+
+	for(i = 0; i < head->len && *pstate != ITER_EXIT; i++)
+	{
+		for(off = bucket[i]; off && *pstate != ITER_EXIT; off = e->next)
+		{
+			e = (const HashImageItem*)(obj->image + off);
+			Blob.data_item = (HashItem*)e;
+			Blob.ht = obj;
+			*pstate = processor(param,(HashBlob_t*)&Blob);
+		}
+	}
+#else
+	(void)obj;
+	(void)processor;
+	(void)param;
+	(void)pstate;
+#endif
+	return 0;
+}
+
+static int _Iteration(HashKv *obj,
+	enum HashIterState (*processor)(void* param,HashBlob_t* ),void *param,
+	enum HashIterState *pstate)
+{
+	HashTab		*t;
+	HashTabHead *item;
+	HashItem	*data_item;
+	HashItem	*work_item;
+	int			i,n;
+	int			ret = 0;
+	enum 		HashIterState state = ITER_KEEP;
+
+	if(_IsImage(obj))
+		return _ImageIteration(obj, processor, param, pstate);
+	if(_MutexLock(obj)) return -2;
+	obj->iterators++;
+
+	/* 迭代期间新表可能被创建,所以每轮都重新判断 */
+	for(n = 0; n < 2 && obj->tab[n].len && state != ITER_EXIT; n++)
+	{
+		t = &obj->tab[n];
+		if(obj->engine == HASH_ENGINE_OPEN)
+		{
+			/* 迭代期间不会迁移数据项,删除只会留下墓碑,槽位置保持不变 */
+			for(i=0;i<t->len && state != ITER_EXIT;i++)
+			{
+				if(t->tag[i] <= HASH_TAG_TOMB)
+					continue;
+				ret = _IterProcess(obj, t->slot[i], processor, param, &state);
+				if(ret) goto out;
+			}
+			continue;
+		}
+
+		item = t->head;
+		for(i=0;i<t->len && state != ITER_EXIT;i++)
+		{
+			list_for_each_entry_safe(data_item, work_item, &item[i].head , list)
+			{
+				if( &work_item->list != &item[i].head)
+					work_item->count++;	/* 提前将下一个引用,防止被误删造成bug */
+				
+				ret = _IterProcess(obj, data_item, processor, param, &state);
+				if(&work_item->list != &item[i].head)
+					work_item->count--; /*去掉引用,即使获取不到锁也要强行去掉 */
+				if(ret) goto out;
+				if(state == ITER_EXIT)
+					break;
+			}
+		}
+	}
+	obj->iterators--;
+	_MutexUnLock(obj);	/* 释放锁 */
+	*pstate = state;
+	return 0;
+out:
+	obj->iterators--;
+	return ret;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_Iteration
+ 功能描述  : 
+ 	遍历所有数据项,迭代期间暂停rehash,处理函数中可以安全地增删数据项
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	processor	处理函数,返回ITER_EXIT时提前结束
+ 	param		传给处理函数的参数
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_Iteration(HashKv_t ht, 
+	enum HashIterState (*processor)(void* param,HashBlob_t* ),void *param)
+{
+	HashKv		*obj = (HashKv*)ht;
+	enum 		HashIterState state = ITER_KEEP;
+	uint32_t	i;
+	int			ret;
+	
+	if(obj == NULL)	return -1;
+	if(!obj->shard)
+		return _Iteration(obj, processor, param, &state);
+
+	/* 分片表逐个分片迭代,同一时刻只持有一个分片的锁 */
+	for(i = 0; i < (1U << obj->shard_bits) && state != ITER_EXIT; i++)
+	{
+		ret = _Iteration(obj->shard[i], processor, param, &state);
+		if(ret) return ret;
+	}
+	return 0;
+}
+
+/* ############################## 游标遍历 ############################# */
+
+#define HASH_SCAN_END		(1ULL << 32)	/* 游标走完一个分片 */
+
+static inline uint32_t _BitRev32(uint32_t v)
+{
+	v = ((v >> 1) & 0x55555555) | ((v & 0x55555555) << 1);
+	v = ((v >> 2) & 0x33333333) | ((v & 0x33333333) << 2);
+	v = ((v >> 4) & 0x0F0F0F0F) | ((v & 0x0F0F0F0F) << 4);
+	v = ((v >> 8) & 0x00FF00FF) | ((v & 0x00FF00FF) << 8);
+	return (v >> 16) | (v << 16);
+}
+
+/* 
+ * 游标位置是混合哈希值的逆序比特,桶号是混合哈希值的低位,
+ * 因此任意长度的表中,一个桶都对应游标空间里连续的一段,
+ * 表扩容或缩容后已经走过的位置依然有效
+ */
+static inline int _ScanHit(uint32_t hash,uint64_t pos,uint64_t end)
+{
+	uint64_t p = _BitRev32(_HashMix(hash));
+	return p >= pos && p < end;
+}
+
+/* 当前最大的表的长度,游标每一步最多走过它的一个桶 */
+static uint32_t _ScanTabLen(HashKv *ht)
+{
+#if HASH_KV_USE_IMAGE
+	if(_IsImage(ht))
+		return ((const HashImageHead*)ht->image)->len;
+#endif
+	return ht->tab[0].len > ht->tab[1].len ? ht->tab[0].len : ht->tab[1].len;
+}
+
+static inline uint32_t _ScanPut(HashKv *ht,HashItem *data_item,HashBlob *out,uint32_t n)
+{
+	if(out){
+		out[n].ht = ht;
+		out[n].data_item = data_item;
+		if(!_IsImage(ht))
+			data_item->count++;
+	}
+	return n + 1;
+}
+
+/* 
+ * 收集游标区间[pos,end)内的数据项,out为NULL时只计数,需已持有表锁
+ * 区间不跨越任何一张表的桶边界,所以每张表只需访问一个桶
+ * (开放寻址为从该桶起直到空槽的一段)
+ */
+static uint32_t _ScanRange(HashKv *ht,uint64_t pos,uint64_t end,uint32_t now,HashBlob *out)
+{
+	uint32_t	mix = _BitRev32((uint32_t)pos);
+	uint32_t	n = 0;
+	uint32_t	i, j, k, mask;
+	HashTab		*t;
+	HashItem	*data_item;
+
+	if(_IsImage(ht))
+	{
+#if HASH_KV_USE_IMAGE
+		const HashImageHead	*head = (const HashImageHead*)ht->image;
+		const uint32_t		*bucket = (const uint32_t*)(head + 1);
+		const HashImageItem	*e;
+		uint32_t			off;
+
+		for(off = bucket[mix & (head->len - 1)]; off; off = e->next)
+		{
+			e = (const HashImageItem*)(ht->image + off);
+			if(_ScanHit(e->hash, pos, end))
+				n = _ScanPut(ht, (HashItem*)e, out, n);
+		}
+#endif
+		return n;
+	}
+
+	for(i = 0; i < 2 && ht->tab[i].len; i++)
+	{
+		t = &ht->tab[i];
+		mask = t->len - 1;
+		j = mix & mask;
+		if(ht->engine == HASH_ENGINE_OPEN)
+		{
+			for(k = 0; k <= mask && t->tag[j] != HASH_TAG_EMPTY; k++, j = (j + 1) & mask)
+			{
+				data_item = t->slot[j];
+				if(t->tag[j] > HASH_TAG_TOMB && _ScanHit(data_item->hash, pos, end) &&
+					!_ItemExpired(data_item, now))
+					n = _ScanPut(ht, data_item, out, n);
+			}
+			continue;
+		}
+		list_for_each_entry(data_item, &t->head[j].head, list)
+		{
+			if(_ScanHit(data_item->hash, pos, end) && !_ItemExpired(data_item, now))
+				n = _ScanPut(ht, data_item, out, n);
+		}
+	}
+	return n;
+}
+
+/* 在一个分片中推进游标,返回收集到的数量,一步也放不下时返回-3 */
+static int _ScanShard(HashKv *ht,HashScan *hs,HashBlob *out,uint32_t room)
+{
+	uint32_t	now = GET_TICK();
+	uint32_t	filled = 0;
+	uint32_t	n;
+	uint64_t	span, end;
+
+	if(!_IsImage(ht) && _MutexLock(ht)) return -2;
+	while(hs->pos < HASH_SCAN_END && filled < room)
+	{
+		span = HASH_SCAN_END / _ScanTabLen(ht);
+		end = (hs->pos & ~(span - 1)) + span;
+		/* 一个桶放不下时把区间对半缩小,直到放得下 */
+		while((n = _ScanRange(ht, hs->pos, end, now, NULL)) > room - filled &&
+			end - hs->pos > 1)
+			end = hs->pos + ((end - hs->pos) >> 1);
+		if(n > room - filled)
+			break;
+		if(n)
+			_ScanRange(ht, hs->pos, end, now, out + filled);
+		filled += n;
+		hs->pos = end;
+	}
+	if(!_IsImage(ht))
+		_MutexUnLock(ht);
+	if(filled == 0 && hs->pos < HASH_SCAN_END)
+		return -3;
+	return filled;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_ScanStart
+ 功能描述  : 
+ 	开始一次游标遍历,之后反复调用 hash_ScanNext 分批取得数据项
+ 	游标不持有任何锁,两次调用之间可以任意增删数据项、扩缩容
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	s			输出参数，请到上层实例化
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_ScanStart(HashKv_t ht,HashScan_t *s)
+{
+	HashScan	*hs = (HashScan*)s;
+	if(!ht || !s) return -1;
+
+	hs->ht = (HashKv*)ht;
+	hs->pos = 0;
+	hs->shard = 0;
+	return 0;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_ScanNext
+ 功能描述  : 
+ 	从游标处继续遍历,取得最多count个数据项,每次调用只锁住一个分片
+ 	整个遍历期间一直存在的键保证至少被返回一次,期间增删的键可能返回也可能不返回,
+ 	表扩缩容时个别键可能被返回多次
+ 	取得的Blob已被引用,用完后需逐个调用 hash_ReleaseBlob
+  参数：
+ 	s			由hash_ScanStart初始化
+ 	b			Blob数组,至少有count个元素
+ 	count		本次最多取得的数量
+  返回值：
+ 	返回取得的数量,遍历结束返回0,
+ 	失败返回负数, -3 表示count太小,连一组哈希值完全相同的键都放不下
+*****************************************************************************/
+int hash_ScanNext(HashScan_t *s,HashBlob_t *b,uint32_t count)
+{
+	HashScan	*hs = (HashScan*)s;
+	HashBlob	*out = (HashBlob*)b;
+	HashKv		*obj;
+	uint32_t	shard_num;
+	uint32_t	filled = 0;
+	int			ret;
+
+	if(!s || !b || !count || !hs->ht) return -1;
+	shard_num = hs->ht->shard ? 1U << hs->ht->shard_bits : 1;
+
+	while(hs->shard < shard_num && filled < count)
+	{
+		obj = hs->ht->shard ? hs->ht->shard[hs->shard] : hs->ht;
+		ret = _ScanShard(obj, hs, out + filled, count - filled);
+		if(ret < 0){
+			if(filled) break;
+			return ret;
+		}
+		filled += ret;
+		if(hs->pos < HASH_SCAN_END)
+			break;
+		hs->shard++;
+		hs->pos = 0;
+	}
+	return filled;
+}
+
+/* ############################## 并行操作 ############################# */
+
+#if HASH_KV_USE_THREAD
+typedef struct _HashParRange{
+	HashKv		*obj;
+	HashTab		*t;				/* 为NULL表示镜像的桶数组 */
+	uint32_t	len;			/* 桶数量 */
+	uint32_t	start;			/* 第一个任务的编号 */
+}HashParRange;					/* 并行遍历: 一张表按桶切分成若干任务 */
+
+typedef struct _HashPar{
+	HashKv		*ht;
+	atomic_uint	next;			/* 下一个待领取的任务 */
+	atomic_uint	ok;				/* 成功的数量 */
+	atomic_int	stop;			/* 有线程要求提前结束 */
+	uint32_t	task_num;
+	void		(*work)(struct _HashPar *par,uint32_t worker);
+	/* 并行遍历 */
+	HashParRange *range;
+	uint32_t	range_num;
+	uint32_t	now;
+	enum HashIterState (*fn)(void *param,uint32_t worker,const void *k,uint32_t k_len,
+					const void *data,uint32_t data_len);
+	void		*param;
+	/* 并行写入 */
+	HashBatch	*bt;			/* 按分片分组后的键 */
+	uint32_t	*shard_off;		/* 每个分片在bt中的起始位置,多一个结尾 */
+	uint32_t	n;
+	const char	**k;
+	const void	**data;
+	const uint32_t *data_len;
+	int			*status;
+}HashPar;						/* 并行操作的共享状态,线程之间通过领取任务编号分工 */
+
+typedef struct _HashParWorker{
+	HashPar		*par;
+	uint32_t	id;
+	pthread_t	tid;
+}HashParWorker;
+
+static void* _ParThread(void *arg)
+{
+	HashParWorker *w = (HashParWorker*)arg;
+	w->par->work(w->par, w->id);
+	return NULL;
+}
+
+/* 领取下一个任务,没有任务或需要提前结束时返回-1 */
+static inline int _ParTake(HashPar *par,uint32_t *task)
+{
+	if(atomic_load_explicit(&par->stop, memory_order_relaxed))
+		return -1;
+	*task = atomic_fetch_add_explicit(&par->next, 1, memory_order_relaxed);
+	return *task < par->task_num ? 0 : -1;
+}
+
+/* 
+ * 用 threads 个线程(含调用者自己)执行 par->work,全部完成后返回
+ * 任务是动态领取的,创建线程失败时剩下的线程照样能完成所有任务
+ */
+static void _ParRun(HashPar *par,uint32_t threads)
+{
+	HashParWorker	w[HASH_PAR_THREADS_MAX];
+	uint32_t		i, started = 0;
+	long			cpus;
+
+	if(threads == 0){
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > 0 ? (uint32_t)cpus : 1;
+	}
+	if(threads > HASH_PAR_THREADS_MAX)
+		threads = HASH_PAR_THREADS_MAX;
+	if(threads > par->task_num)
+		threads = par->task_num ? par->task_num : 1;
+
+	atomic_store(&par->next, 0);
+	for(i = 1; i < threads; i++)
+	{
+		w[started].par = par;
+		w[started].id = i;
+		if(pthread_create(&w[started].tid, NULL, _ParThread, &w[started]) == 0)
+			started++;
+	}
+	par->work(par, 0);
+	for(i = 0; i < started; i++)
+		pthread_join(w[i].tid, NULL);
+}
+
+static enum HashIterState _ParVisit(HashPar *par,uint32_t worker,HashItem *data_item)
+{
+	if(_ItemExpired(data_item, par->now))
+		return ITER_KEEP;
+	return par->fn(par->param, worker, data_item->k, data_item->k_len,
+				data_item->v, data_item->v_len);
+}
+
+/* 并行遍历: 每个任务是一张表中连续的 HASH_PAR_CHUNK 个桶 */
+static void _ParForEachWork(HashPar *par,uint32_t worker)
+{
+	HashParRange	*r;
+	HashItem		*data_item;
+	uint32_t		task, i, end, lo, hi;
+	enum HashIterState state = ITER_KEEP;
+
+	while(state != ITER_EXIT && _ParTake(par, &task) == 0)
+	{
+		/* 二分查找任务所在的表 */
+		for(lo = 0, hi = par->range_num; hi - lo > 1; )
+		{
+			if(par->range[(lo + hi) / 2].start <= task)
+				lo = (lo + hi) / 2;
+			else
+				hi = (lo + hi) / 2;
+		}
+		r = &par->range[lo];
+		i = (task - r->start) * HASH_PAR_CHUNK;
+		end = i + HASH_PAR_CHUNK < r->len ? i + HASH_PAR_CHUNK : r->len;
+		for(; i < end && state != ITER_EXIT; i++)
+		{
+			if(!r->t)
+			{
+#if HASH_KV_USE_IMAGE
+				const uint32_t		*bucket = (const uint32_t*)((const HashImageHead*)r->obj->image + 1);
+				const HashImageItem	*e;
+				uint32_t			off;
+
+				for(off = bucket[i]; off && state != ITER_EXIT; off = e->next)
+				{
+					e = (const HashImageItem*)(r->obj->image + off);
+					state = par->fn(par->param, worker, e->k, e->k_len, _ImageVal(e), e->v_len);
+				}
+#endif
+				continue;
+			}
+			if(r->obj->engine == HASH_ENGINE_OPEN)
+			{
+				if(r->t->tag[i] > HASH_TAG_TOMB)
+					state = _ParVisit(par, worker, r->t->slot[i]);
+				continue;
+			}
+			list_for_each_entry(data_item, &r->t->head[i].head, list)
+			{
+				state = _ParVisit(par, worker, data_item);
+				if(state == ITER_EXIT)
+					break;
+			}
+		}
+	}
+	if(state == ITER_EXIT)
+		atomic_store(&par->stop, 1);
+}
+
+static void _ParAddRange(HashPar *par,HashKv *obj,HashTab *t,uint32_t len)
+{
+	HashParRange *r = &par->range[par->range_num++];
+
+	r->obj = obj;
+	r->t = t;
+	r->len = len;
+	r->start = par->task_num;
+	par->task_num += (len + HASH_PAR_CHUNK - 1) / HASH_PAR_CHUNK;
+}
+#endif
+
+/*****************************************************************************
+ 函 数 名  : hash_ParallelForEach
+ 功能描述  : 
+ 	用多个线程并行遍历所有数据项,适合持久化、重建索引等批量只读处理
+ 	遍历期间持有所有分片的锁,其他线程的写操作会被阻塞;
+ 	处理函数在多个线程中并发执行,其中不能调用本表的任何接口,
+ 	键与值的指针只在处理函数内有效
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	threads		线程数量(含调用者自己),0表示使用所有在线的CPU
+ 	fn			处理函数,worker为线程编号(0..threads-1),返回ITER_EXIT时所有线程尽快结束
+ 	param		传给处理函数的参数
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_ParallelForEach(HashKv_t ht,uint32_t threads,
+	enum HashIterState (*fn)(void *param,uint32_t worker,const void *k,uint32_t k_len,
+				const void *data,uint32_t data_len),void *param)
+{
+#if HASH_KV_USE_THREAD
+	HashKv		*obj = (HashKv*)ht;
+	HashKv		*sh;
+	HashPar		par;
+	uint32_t	shard_num, i, n;
+
+	if(!obj || !fn) return -1;
+	shard_num = obj->shard ? 1U << obj->shard_bits : 1;
+	memset(&par, 0, sizeof(par));
+	par.range = MALLOC(shard_num * 2 * sizeof(HashParRange));
+	if(!par.range) return -1;
+	if(_LockAll(obj)){
+		FREE(par.range);
+		return -2;
+	}
+	for(i = 0; i < shard_num; i++)
+	{
+		sh = obj->shard ? obj->shard[i] : obj;
+#if HASH_KV_USE_IMAGE
+		if(_IsImage(sh)){
+			_ParAddRange(&par, sh, NULL, ((const HashImageHead*)sh->image)->len);
+			continue;
+		}
+#endif
+		for(n = 0; n < 2 && sh->tab[n].len; n++)
+			_ParAddRange(&par, sh, &sh->tab[n], sh->tab[n].len);
+	}
+	par.ht = obj;
+	par.work = _ParForEachWork;
+	par.now = GET_TICK();
+	par.fn = fn;
+	par.param = param;
+	_ParRun(&par, threads);
+	_UnlockAll(obj);
+	FREE(par.range);
+	return 0;
+#else
+	(void)ht;
+	(void)threads;
+	(void)fn;
+	(void)param;
+	return -1;
+#endif
+}
+
+#if HASH_KV_USE_THREAD
+/* 并行写入第一步: 每个任务计算 HASH_PAR_CHUNK 个键的哈希 */
+static void _ParHashWork(HashPar *par,uint32_t worker)
+{
+	uint32_t	task, i, end;
+	HashBatch	*e;
+
+	(void)worker;
+	while(_ParTake(par, &task) == 0)
+	{
+		i = task * HASH_PAR_CHUNK;
+		end = i + HASH_PAR_CHUNK < par->n ? i + HASH_PAR_CHUNK : par->n;
+		for(; i < end; i++)
+		{
+			e = &par->bt[i];
+			e->hash = _KeyHash(par->ht, par->k[i], &e->k_len);
+			e->obj = _ShardRoute(par->ht, e->hash);
+			e->idx = i;
+		}
+	}
+}
+
+/* 并行写入第二步: 每个任务是一个分片,整批写入只加一次锁 */
+static void _ParSetWork(HashPar *par,uint32_t worker)
+{
+	uint32_t	task, m, end;
+	HashKv		*sh;
+	HashBatch	*e;
+	int			ret;
+
+	(void)worker;
+	while(_ParTake(par, &task) == 0)
+	{
+		m = par->shard_off[task];
+		end = par->shard_off[task + 1];
+		if(m == end)
+			continue;
+		sh = par->bt[m].obj;
+		if(_IsImage(sh) || _MutexLock(sh))
+		{
+			for(; m < end; m++)
+				if(par->status)
+					par->status[par->bt[m].idx] = _IsImage(sh) ? -1 : -2;
+			continue;
+		}
+		/* 一次扩到能容纳整批数据项的大小,避免写入过程中反复扩容 */
+		if(!_IsRehashing(sh) && _TabOverload(sh, &sh->tab[0], end - m))
+			_TabResize(sh, _TabFitLen(sh, sh->tab[0].used + end - m));
+		for(; m < end; m++)
+		{
+			e = &par->bt[m];
+			if(m + HASH_BATCH_PREFETCH < end)
+				_ItemPrefetch(sh, par->bt[m + HASH_BATCH_PREFETCH].hash);
+			if(!par->data[e->idx] || par->data_len[e->idx] == 0)
+				ret = -1;
+			else
+				ret = _SetDataLocked(sh, e->hash, par->k[e->idx], e->k_len,
+							par->data[e->idx], par->data_len[e->idx]);
+			if(par->status)
+				par->status[e->idx] = ret;
+			if(ret >= 0)
+				atomic_fetch_add_explicit(&par->ok, 1, memory_order_relaxed);
+		}
+		_MutexUnLock(sh);
+	}
+}
+#endif
+
+/*****************************************************************************
+ 函 数 名  : hash_ParallelSet
+ 功能描述  : 
+ 	用多个线程批量写入,适合从数组一次性构建表
+ 	先并行计算所有键的哈希并按分片分组,再由各线程分别领取分片写入,
+ 	每个分片只加一次锁;未分片的表只有哈希计算是并行的
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	threads		线程数量(含调用者自己),0表示使用所有在线的CPU
+ 	n			键的数量
+ 	k			键值数组
+ 	data		值数组
+ 	data_len	值长度数组
+ 	status		输出每个键的结果,与 hash_SetData 的返回值相同,可以为NULL
+  返回值：
+ 	成功返回成功的键数量,参数错误返回负数
+*****************************************************************************/
+int hash_ParallelSet(HashKv_t ht,uint32_t threads,uint32_t n,const char **k,
+				const void **data,const uint32_t *data_len,int *status)
+{
+#if HASH_KV_USE_THREAD
+	HashKv		*obj = (HashKv*)ht;
+	HashPar		par;
+	HashBatch	*sorted;
+	uint32_t	shard_num, i;
+
+	if(!obj || !k || !data || !data_len) return -1;
+	for(i = 0; i < n; i++)
+		if(!k[i]) return -1;
+	if(n == 0) return 0;
+	shard_num = obj->shard ? 1U << obj->shard_bits : 1;
+
+	memset(&par, 0, sizeof(par));
+	par.bt = MALLOC(n * 2 * sizeof(HashBatch) + (shard_num + 1) * sizeof(uint32_t));
+	if(!par.bt) return -1;
+	sorted = par.bt + n;
+	par.shard_off = (uint32_t*)(sorted + n);
+	par.ht = obj;
+	par.n = n;
+	par.k = k;
+	par.data = data;
+	par.data_len = data_len;
+	par.status = status;
+
+	par.work = _ParHashWork;
+	par.task_num = (n + HASH_PAR_CHUNK - 1) / HASH_PAR_CHUNK;
+	_ParRun(&par, threads);
+
+	/* 按分片计数排序,同一分片内保持原来的顺序 */
+	memset(par.shard_off, 0, (shard_num + 1) * sizeof(uint32_t));
+	for(i = 0; i < n; i++)
+		par.shard_off[par.bt[i].obj->shard_id + 1]++;
+	for(i = 0; i < shard_num; i++)
+		par.shard_off[i + 1] += par.shard_off[i];
+	for(i = 0; i < n; i++)
+		sorted[par.shard_off[par.bt[i].obj->shard_id]++] = par.bt[i];
+	for(i = shard_num; i > 0; i--)
+		par.shard_off[i] = par.shard_off[i - 1];
+	par.shard_off[0] = 0;
+
+	memmove(par.bt, sorted, n * sizeof(HashBatch));
+	par.work = _ParSetWork;
+	par.task_num = shard_num;
+	_ParRun(&par, threads);
+	FREE(par.bt);
+	return (int)atomic_load(&par.ok);
+#else
+	(void)ht;
+	(void)threads;
+	(void)n;
+	(void)k;
+	(void)data;
+	(void)data_len;
+	(void)status;
+	return -1;
+#endif
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_GetData
+ 功能描述  : 
+ 	获取值
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	k			键值
+ 	buf			缓冲区
+ 	read_size	要读的大小
+  返回值：
+ 	成功返回读到的字节数,失败返回负数
+*****************************************************************************/
+void hash_SetLock(HashKv_t ht,int (*lock)(void),void (*unlock)(void))
+{
+	HashKv		*obj = (HashKv*)ht;
+	uint32_t	i;
+	if(obj){
+		obj->lock 	= lock;
+		obj->unlock = unlock;
+		/* 分片表的所有分片共用这一把锁 */
+		for(i = 0; obj->shard && i < (1U << obj->shard_bits); i++)
+			hash_SetLock(obj->shard[i], lock, unlock);
+	}
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_SetShardLock
+ 功能描述  : 
+ 	设置分片锁,每个分片使用独立的锁,访问不同分片的线程互不阻塞
+ 	设置后优先于 hash_SetLock 设置的锁
+  参数：
+ 	ht 			由hash_NewSharded生成的HashKv_t,未分片的表视为只有0号分片
+ 	lock		加锁函数,参数为分片编号[0,分片数量),请提供递归锁
+ 	unlock		解锁函数,参数为分片编号
+*****************************************************************************/
+void hash_SetShardLock(HashKv_t ht,int (*lock)(uint32_t shard),void (*unlock)(uint32_t shard))
+{
+	HashKv		*obj = (HashKv*)ht;
+	uint32_t	i;
+	if(obj){
+		obj->shard_lock 	= lock;
+		obj->shard_unlock	= unlock;
+		for(i = 0; obj->shard && i < (1U << obj->shard_bits); i++)
+			hash_SetShardLock(obj->shard[i], lock, unlock);
+	}
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_GetShardNum
+ 功能描述  : 
+ 	获取分片数量
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+  返回值：
+ 	分片数量,未分片的表返回1
+*****************************************************************************/
+uint32_t hash_GetShardNum(HashKv_t ht)
+{
+	HashKv		*obj = (HashKv*)ht;
+	if(!obj || !obj->shard) return 1;
+	return 1U << obj->shard_bits;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_SetHashPolicy
+ 功能描述  : 
+ 	设置哈希算法,默认为 HASH_POLICY_RS
+ 	HASH_POLICY_WY 每轮处理16字节,并在同一趟扫描中求出键长,对前缀相同的键分布也更好
+  参数：
+ 	ht 			由hash_New生成的HashKv_t,必须为空表
+ 	policy		哈希算法,见 enum HashPolicy
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_SetHashPolicy(HashKv_t ht,enum HashPolicy policy)
+{
+	HashKv		*obj = (HashKv*)ht;
+	HashKv		*sub;
+	uint32_t	i,num;
+	if(!obj || (uint32_t)policy > HASH_POLICY_WY || _IsImage(obj)) return -1;
+	num = obj->shard ? 1U << obj->shard_bits : 1;
+	if(_LockAll(obj)) return -2;
+	/* 所有分片都是空表才修改,否则各分片的算法会不一致 */
+	for(i = 0; i < num; i++)
+	{
+		sub = obj->shard ? obj->shard[i] : obj;
+		if(sub->tab[0].used || _IsRehashing(sub) || _IsImage(sub)){
+			_UnlockAll(obj);
+			return -1;
+		}
+	}
+	for(i = 0; i < num; i++)
+		(obj->shard ? obj->shard[i] : obj)->policy = policy;
+	obj->policy = policy;
+	_UnlockAll(obj);
+	return 0;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_SetMemBudget
+ 功能描述  : 
+ 	设置内存上限(数据项与值实际占用的字节数,见 hash_GetMemStats),
+ 	写入后超出上限时按近似LRU(CLOCK)淘汰,被 HashBlob_t 引用的数据项不会被淘汰
+ 	分片表按分片平分上限
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	bytes		内存上限,0表示不限制
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_SetMemBudget(HashKv_t ht,uint64_t bytes)
+{
+	HashKv		*obj = (HashKv*)ht;
+	uint32_t	i;
+	if(!obj || _IsImage(obj)) return -1;
+	if(obj->shard)
+	{
+		for(i = 0; i < (1U << obj->shard_bits); i++)
+			if(hash_SetMemBudget(obj->shard[i], bytes ? (bytes >> obj->shard_bits) + 1 : 0))
+				return -2;
+		obj->mem_budget = bytes;
+		return 0;
+	}
+	if(_MutexLock(obj)) return -2;
+	obj->mem_budget = bytes;
+	_CacheTrim(obj);
+	_MutexUnLock(obj);
+	return 0;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_Expire
+ 功能描述  : 
+ 	设置键的存活时间,过期的键在访问时或由 hash_Sweep 删除
+ 	hash_SetData 覆盖值时不改变存活时间
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	k			键值
+ 	ttl			存活的毫秒数,0表示永不过期,不能超过2^31
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_Expire(HashKv_t ht,const char* k,uint32_t ttl)
+{
+	HashKv		*obj = (HashKv*)ht;
+	HashItem	*data_item;
+	uint32_t	hash, k_len;
+	if(!obj || !k || ttl > INT32_MAX) return -1;
+	
+	hash = _KeyHash(obj,k,&k_len);
+	obj = _ShardRoute(obj, hash);
+	if(_IsImage(obj)) return -1;
+	if(_MutexLock(obj)) return -2;
+	data_item = _ItemSearchLive(obj,hash,k,k_len,0);
+	if(data_item)
+		_ItemSetTTL(data_item, ttl);
+	_MutexUnLock(obj);
+	return data_item ? 0 : -1;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_SetDataTTL
+ 功能描述  : 
+ 	设置值并同时设置存活时间,对于不存在的值会自动新建
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	k			键值
+ 	data		数据缓冲区 
+ 	data_len	数据大小，必须大于0
+ 	ttl			存活的毫秒数,0表示永不过期,不能超过2^31
+  返回值：
+ 	成功返回设置的字节数,失败返回负数
+*****************************************************************************/
+int hash_SetDataTTL(HashKv_t ht,const char* k,const void* data,uint32_t data_len,uint32_t ttl)
+{
+	HashKv		*obj = (HashKv*)ht;
+	HashItem	*data_item;
+	int 		ret = 0;
+	uint32_t	hash, k_len;
+	
+	if(!obj || !k || data_len == 0 || !data || ttl > INT32_MAX)  return -1;
+	
+	hash = _KeyHash(obj,k,&k_len);
+	obj = _ShardRoute(obj, hash);
+	if(_IsImage(obj)) return -1;
+	if(_MutexLock(obj)) return -2;
+	ret = _SetDataLocked(obj,hash,k,k_len,data,data_len);
+	if(ret >= 0)
+	{
+		/* 写入后可能因为淘汰而不存在,但刚写入的数据项不会被淘汰 */
+		data_item = _ItemSearch(obj,hash,k,k_len);
+		if(data_item)
+			_ItemSetTTL(data_item, ttl);
+	}
+	_MutexUnLock(obj);
+	return ret;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_Sweep
+ 功能描述  : 
+ 	增量清理过期的键,每次从上次的位置继续扫描,可在空闲时周期性调用
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	steps		每个分片最多扫描的桶数量
+  返回值：
+ 	成功返回删除的键数量,失败返回负数
+*****************************************************************************/
+int hash_Sweep(HashKv_t ht,uint32_t steps)
+{
+	HashKv		*obj = (HashKv*)ht;
+	uint32_t	i;
+	int			ret, removed = 0;
+	if(!obj) return -1;
+	if(_IsImage(obj)) return 0;
+	if(obj->shard)
+	{
+		for(i = 0; i < (1U << obj->shard_bits); i++)
+		{
+			ret = hash_Sweep(obj->shard[i], steps);
+			if(ret < 0) return ret;
+			removed += ret;
+		}
+		return removed;
+	}
+	if(_MutexLock(obj)) return -2;
+	removed = (int)_CacheSweep(obj, steps);
+	_MutexUnLock(obj);
+	return removed;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_GetCacheStats
+ 功能描述  : 
+ 	获取命中/未命中/淘汰/过期计数,分片表为所有分片之和
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	st			输出参数
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_GetCacheStats(HashKv_t ht,HashCacheStats *st)
+{
+	HashKv		*obj = (HashKv*)ht;
+	HashCacheStats sub;
+	uint32_t	i;
+	if(!obj || !st) return -1;
+	if(obj->shard)
+	{
+		memset(st, 0, sizeof(*st));
+		for(i = 0; i < (1U << obj->shard_bits); i++)
+		{
+			if(hash_GetCacheStats(obj->shard[i], &sub)) return -2;
+			st->hit += sub.hit;
+			st->miss += sub.miss;
+			st->evicted += sub.evicted;
+			st->expired += sub.expired;
+		}
+		return 0;
+	}
+	if(_MutexLock(obj)) return -2;
+	*st = obj->cst;
+#if HASH_KV_USE_RCU
+	for(i = 0; obj->rcu_slot && i < HASH_RCU_SLOTS; i++)
+	{
+		st->hit += atomic_load_explicit(&obj->rcu_slot[i].hit, memory_order_relaxed);
+		st->miss += atomic_load_explicit(&obj->rcu_slot[i].miss, memory_order_relaxed);
+	}
+#endif
+	_MutexUnLock(obj);
+	return 0;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_GetMemStats
+ 功能描述  : 
+ 	获取内存使用统计,分片表为所有分片之和
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	st			输出参数
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_GetMemStats(HashKv_t ht,HashMemStats *st)
+{
+	HashKv		*obj = (HashKv*)ht;
+	HashMemStats sub;
+	uint32_t	i;
+	if(!obj || !st) return -1;
+	if(obj->shard)
+	{
+		memset(st, 0, sizeof(*st));
+		for(i = 0; i < (1U << obj->shard_bits); i++)
+		{
+			if(hash_GetMemStats(obj->shard[i], &sub)) return -2;
+			st->used += sub.used;
+			st->wasted += sub.wasted;
+			st->idle += sub.idle;
+			st->slab += sub.slab;
+			st->large += sub.large;
+			st->inline_val += sub.inline_val;
+		}
+		return 0;
+	}
+	if(_MutexLock(obj)) return -2;
+	*st = obj->slab.st;
+	/* slab页中除了已分配出去的部分都算作空闲 */
+	st->idle = st->slab - (st->used - st->large) - st->wasted;
+	_MutexUnLock(obj);
+	return 0;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_SetReadMostly
+ 功能描述  : 
+ 	开启读多写少模式: hash_GetData 不再加锁,读者按宽限期计数登记
+ 	写操作仍然加锁,总是发布新版本的值,被替换的值与删除的数据项
+ 	在所有可能看到它们的读者离开后才真正释放
+ 	宽限期由之后的写操作顺带推进,写操作不等待读者,代价是最多约
+ 	HASH_RCU_RETIRE_BATCH + HASH_RCU_RETIRE_MAX 个旧对象延后释放;
+ 	读者长时间不离开使待回收对象超过 HASH_RCU_RETIRE_MAX 时,
+ 	写操作会持锁让出CPU等待读者,此时写延迟取决于读者临界区的长短
+ 	只支持拉链法引擎,且开启后不再自动扩缩容,请在创建时给足长度
+  参数：
+ 	ht 			由hash_New生成的HashKv_t,必须为空表
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_SetReadMostly(HashKv_t ht)
+{
+	HashKv		*obj = (HashKv*)ht;
+	HashKv		*sub;
+	uint32_t	i,num;
+	int			ret = -1;
+	if(!obj) return -1;
+#if HASH_KV_USE_RCU
+	if(obj->engine != HASH_ENGINE_CHAIN || _IsImage(obj)) return -1;
+	num = obj->shard ? 1U << obj->shard_bits : 1;
+	if(_LockAll(obj)) return -2;
+	if(obj->rcu){
+		ret = 0;
+		goto out;
+	}
+	/* 先检查所有分片并申请好读者计数,任何一个分片不满足都不改动整个表 */
+	for(i = 0; i < num; i++)
+	{
+		sub = obj->shard ? obj->shard[i] : obj;
+		if(sub->tab[0].used || _IsRehashing(sub) || _IsImage(sub))
+			goto rollback;
+		sub->rcu_slot = MALLOC(sizeof(HashRcuSlot) * HASH_RCU_SLOTS);
+		if(!sub->rcu_slot)
+			goto rollback;
+		memset(sub->rcu_slot, 0, sizeof(HashRcuSlot) * HASH_RCU_SLOTS);
+	}
+	for(i = 0; i < num; i++)
+	{
+		sub = obj->shard ? obj->shard[i] : obj;
+		sub->grow = 0;
+		sub->shrink = 0;
+		sub->rcu = 1;
+	}
+	obj->rcu = 1;
+	ret = 0;
+	goto out;
+rollback:
+	while(i--)
+	{
+		sub = obj->shard ? obj->shard[i] : obj;
+		FREE(sub->rcu_slot);
+		sub->rcu_slot = NULL;
+	}
+out:
+	_UnlockAll(obj);
+	return ret;
+#else
+	(void)sub;
+	(void)i;
+	(void)num;
+	return ret;
+#endif
+}
+
+/* ############################## 变更通知 ############################# */
+
+#if HASH_KV_USE_WATCH
+/* 第一次注册时为每个分片创建事件队列,调用前需已锁住所有分片 */
+static HashWatch* _WatchCreate(HashKv *obj)
+{
+	uint32_t	shard_num = obj->shard ? 1U << obj->shard_bits : 1;
+	HashWatch	*w;
+	uint32_t	i;
+
+	w = MALLOC(sizeof(HashWatch) + shard_num * sizeof(HashWatchQueue));
+	if(!w) return NULL;
+	memset(w, 0, sizeof(HashWatch) + shard_num * sizeof(HashWatchQueue));
+	w->shard_num = shard_num;
+	for(i = 0; i < shard_num; i++)
+	{
+		if(pfifo_alloc(&w->q[i].fifo, HASH_WATCH_QUEUE)){
+			while(i--)
+				pfifo_free(&w->q[i].fifo);
+			FREE(w);
+			return NULL;
+		}
+		atomic_init(&w->q[i].gen, 1);	/* 数据项的批次号初始为0,不会与之相同 */
+		atomic_init(&w->q[i].overflow, 0);
+	}
+	for(i = 0; obj->shard && i < shard_num; i++)
+		obj->shard[i]->watch = w;
+	obj->watch = w;
+	return w;
+}
+
+static HashWatchKey* _WatchFind(HashWatch *w,const void* key,uint32_t key_len,uint8_t exact)
+{
+	uint32_t	i;
+
+	for(i = 0; i < w->num; i++)
+	{
+		if(w->key[i].len == key_len && w->key[i].exact == exact &&
+			!memcmp(w->key[i].key, key, key_len))
+			return &w->key[i];
+	}
+	return NULL;
+}
+#endif
+
+static void _WatchFree(HashKv *obj)
+{
+#if HASH_KV_USE_WATCH
+	HashWatch	*w = obj->watch;
+	uint32_t	i;
+
+	if(!w) return;
+	for(i = 0; i < w->num; i++)
+		FREE(w->key[i].key);
+	if(w->key)
+		FREE(w->key);
+	for(i = 0; i < w->shard_num; i++)
+		pfifo_free(&w->q[i].fifo);
+	FREE(w);
+	obj->watch = NULL;
+#else
+	(void)obj;
+#endif
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_Watch
+ 功能描述  : 
+ 	关注一个键或一个前缀,之后这些键被写入、删除(包括过期与淘汰)时
+ 	事件会放入无锁队列,由 hash_WatchDrain 分批取出
+ 	同一个键在两次取出之间的多次写入只会产生一个事件
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	key			键或前缀,前缀长度为0表示关注所有键
+ 	key_len		长度
+ 	prefix		为1时关注所有以key开头的键,为0时只关注key本身
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_Watch(HashKv_t ht,const void* key,uint32_t key_len,int prefix)
+{
+#if HASH_KV_USE_WATCH
+	HashKv			*obj = (HashKv*)ht;
+	HashWatch		*w;
+	HashWatchKey	*e;
+	char			*k;
+
+	if(!obj || (!key && key_len) || _IsImage(obj)) return -1;
+	k = MALLOC(key_len + 1);
+	if(!k) return -1;
+	memcpy(k, key, key_len);
+	if(_LockAll(obj)){
+		FREE(k);
+		return -2;
+	}
+	w = obj->watch ? obj->watch : _WatchCreate(obj);
+	if(!w)
+		goto err;
+	if(_WatchFind(w, k, key_len, !prefix)){
+		_UnlockAll(obj);
+		FREE(k);
+		return 0;
+	}
+	e = MALLOC((w->num + 1) * sizeof(HashWatchKey));
+	if(!e)
+		goto err;
+	if(w->num)
+		memcpy(e, w->key, w->num * sizeof(HashWatchKey));
+	if(w->key)
+		FREE(w->key);
+	w->key = e;
+	e = &w->key[w->num++];
+	e->key = k;
+	e->len = key_len;
+	e->exact = !prefix;
+	_UnlockAll(obj);
+	return 0;
+err:
+	_UnlockAll(obj);
+	FREE(k);
+	return -1;
+#else
+	(void)ht;
+	(void)key;
+	(void)key_len;
+	(void)prefix;
+	return -1;
+#endif
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_Unwatch
+ 功能描述  : 
+ 	取消 hash_Watch 的关注,已经放入队列的事件仍可以取出
+  参数：
+ 	与 hash_Watch 相同
+  返回值：
+ 	成功返回0,没有找到返回负数
+*****************************************************************************/
+int hash_Unwatch(HashKv_t ht,const void* key,uint32_t key_len,int prefix)
+{
+#if HASH_KV_USE_WATCH
+	HashKv			*obj = (HashKv*)ht;
+	HashWatchKey	*e;
+	int				ret = -1;
+
+	if(!obj || (!key && key_len) || !obj->watch) return -1;
+	if(_LockAll(obj)) return -2;
+	e = _WatchFind(obj->watch, key, key_len, !prefix);
+	if(e){
+		FREE(e->key);
+		*e = obj->watch->key[--obj->watch->num];
+		ret = 0;
+	}
+	_UnlockAll(obj);
+	return ret;
+#else
+	(void)ht;
+	(void)key;
+	(void)key_len;
+	(void)prefix;
+	return -1;
+#endif
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_WatchDrain
+ 功能描述  : 
+ 	取出变更事件,同一时刻只能有一个线程调用,不需要加锁
+ 	HASH_WATCH_SET 只说明键变化过,请在fn中重新读取,读到时它可能已被删除
+ 	收到 HASH_WATCH_OVERFLOW 时说明有事件被丢弃,需要重新读取所有关注的键
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	max			最多取出的事件数量,0表示取完为止
+ 	fn			处理函数,k/k_len只在fn内有效,其中可以调用本表的接口
+ 	param		传给处理函数的参数
+  返回值：
+ 	返回取出的事件数量,失败返回负数
+*****************************************************************************/
+int hash_WatchDrain(HashKv_t ht,uint32_t max,
+	void (*fn)(void *param,enum HashWatchEvent ev,const void *k,uint32_t k_len),void *param)
+{
+#if HASH_KV_USE_WATCH
+	HashKv			*obj = (HashKv*)ht;
+	HashWatchQueue	*q;
+	uint8_t			buf[HASH_WATCH_BATCH];
+	uint32_t		used, off, len, got;
+	uint32_t		i, n = 0;
+
+	if(!obj || !fn) return -1;
+	if(!obj->watch) return 0;
+	if(max == 0) max = UINT32_MAX;
+
+	for(i = 0; i < obj->watch->shard_num && n < max; i++)
+	{
+		q = &obj->watch->q[i];
+		if(atomic_exchange(&q->overflow, 0)){
+			fn(param, HASH_WATCH_OVERFLOW, NULL, 0);
+			n++;
+		}
+		while(n < max && !pfifo_is_empty(&q->fifo))
+		{
+			/* 先取出一批,推进批次号之后再处理,之后的写入会重新入队 */
+			for(used = got = 0; n + got < max && !pfifo_is_empty(&q->fifo); got++)
+			{
+				len = pfifo_peek_len(&q->fifo);
+				if(used + sizeof(uint16_t) + len > sizeof(buf))
+					break;
+				len = pfifo_out(&q->fifo, buf + used + sizeof(uint16_t), len);
+				buf[used] = (uint8_t)len;
+				buf[used + 1] = (uint8_t)(len >> 8);
+				used += sizeof(uint16_t) + len;
+			}
+			atomic_fetch_add(&q->gen, 1);
+			for(off = 0; off < used; off += sizeof(uint16_t) + len, n++)
+			{
+				len = buf[off] | (uint32_t)buf[off + 1] << 8;
+				fn(param, (enum HashWatchEvent)buf[off + sizeof(uint16_t)],
+					buf + off + sizeof(uint16_t) + 1, len - 1);
+			}
+		}
+	}
+	return n;
+#else
+	(void)ht;
+	(void)max;
+	(void)fn;
+	(void)param;
+	return -1;
+#endif
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_Del
+ 功能描述  : 
+ 	删除哈希表
+ 参数：
+ 	ht 			由hash_New生成的HashKv_t
+ *****************************************************************************/
+void hash_Del(HashKv_t ht)
+{
+	HashKv		*obj = (HashKv*)ht;
+	HashTab		*t;
+	HashItem	*data_item;
+	HashItem	*work_item;
+	
+	int			i,n;
+	if(obj == NULL)	return ;
+	if(obj->shard)
+	{
+		for(i = 0; i < (1 << obj->shard_bits); i++)
+		{
+#if HASH_KV_USE_WATCH
+			obj->shard[i]->watch = NULL;	/* 由分片表统一释放 */
+#endif
+			hash_Del(obj->shard[i]);
+		}
+		_WatchFree(obj);
+		FREE(obj);
+		return ;
+	}
+	/* 先一项一项释放，最后再一起释放 */
+	_RcuReclaim(obj, 0);
+	for(n = 0; n < 2; n++)
+	{
+		t = &obj->tab[n];
+		for(i=0;i<t->len ;i++)
+		{
+			if(obj->engine == HASH_ENGINE_OPEN)
+			{
+				if(t->tag[i] > HASH_TAG_TOMB)
+					_FreeItem(obj,t->slot[i]);
+				continue;
+			}
+			list_for_each_entry_safe(data_item, work_item, &t->head[i].head , list)
+			{
+				_FreeItem(obj,data_item);
+			}
+		}
+		if(t->len)
+			_TabFree(obj, t);
+	}
+	_SlabDestroy(obj);
+	_WatchFree(obj);
+#if HASH_KV_USE_IMAGE
+	if(obj->image)
+		munmap((void*)obj->image, obj->image_size);
+#endif
+#if HASH_KV_USE_RCU
+	if(obj->rcu_slot)
+		FREE(obj->rcu_slot);
+#endif
+	FREE(obj);
+}
+
+
+
+/*****************************************************************************
+ 函 数 名  : hash_SetAutoResize
+ 功能描述  : 
+ 	设置自动扩容/缩容,新建的哈希表默认自动扩容,不自动缩容
+ 	扩缩容以渐进方式完成,每次操作只迁移少量桶
+ 	开放寻址引擎总是自动扩容
+ 参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	grow		装载率超过1时是否扩容
+ 	shrink		装载率低于1/8时是否缩容,不会小于创建时的长度
+*****************************************************************************/
+void hash_SetAutoResize(HashKv_t ht,int grow,int shrink)
+{
+	HashKv		*obj = (HashKv*)ht;
+	uint32_t	i;
+	if(obj){
+		/* 读多写少模式下迁移数据项会让无锁读者漏掉数据,不允许扩缩容 */
+		obj->grow 	= grow && !obj->rcu ? 1 : 0;
+		obj->shrink = shrink && !obj->rcu ? 1 : 0;
+		for(i = 0; obj->shard && i < (1U << obj->shard_bits); i++)
+			hash_SetAutoResize(obj->shard[i], grow, shrink);
+	}
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_NewEx
+ 功能描述  : 
+ 	新建一个hash表,并指定存储引擎
+ 参数：
+ 	tab_len hash表的初始长度，会向上取整为2的幂
+ 	engine	存储引擎,见 enum HashEngine
+ 返回值：
+ 	成功返回哈希表对象，失败返回NULL
+*****************************************************************************/
+HashKv_t hash_NewEx(uint32_t tab_len, enum HashEngine engine)
+{
+	HashKv 		*obj;
+	
+	if(tab_len == 0) return NULL;
+	if(engine != HASH_ENGINE_CHAIN && engine != HASH_ENGINE_OPEN) return NULL;
+
+	obj = MALLOC(sizeof(HashKv));
+	if(obj == NULL) return NULL;
+	memset(obj, 0, sizeof(HashKv));
+	obj->engine = engine;
+	obj->policy = HASH_POLICY_DEFAULT;
+	obj->grow = 1;
+	obj->min_len = _RoundupPowOfTwo(tab_len);
+	if(_TabAlloc(obj, &obj->tab[0], obj->min_len))
+	{
+		FREE(obj);
+		return NULL;
+	}
+	return (HashKv_t)obj;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_NewSharded
+ 功能描述  : 
+ 	新建一个分片的hash表,键按哈希值分散到各个分片,每个分片是独立的子表
+ 	配合 hash_SetShardLock 使用,访问不同分片的键可以在多个核上并行
+ 参数：
+ 	tab_len 	每个分片的初始长度
+ 	engine		存储引擎,见 enum HashEngine
+ 	shard_num	分片数量,会向上取整为2的幂,最多1024个
+ 返回值：
+ 	成功返回哈希表对象，失败返回NULL
+*****************************************************************************/
+HashKv_t hash_NewSharded(uint32_t tab_len, enum HashEngine engine, uint32_t shard_num)
+{
+	HashKv 		*obj;
+	uint32_t	bits = 0;
+	uint32_t	i;
+
+	if(shard_num == 0 || shard_num > 1024) return NULL;
+	while((1U << bits) < shard_num)
+		bits++;
+	if(bits == 0)
+		return hash_NewEx(tab_len, engine);
+
+	obj = MALLOC(sizeof(HashKv) + sizeof(HashKv*) * (1U << bits));
+	if(obj == NULL) return NULL;
+	memset(obj, 0, sizeof(HashKv));
+	obj->engine = engine;
+	obj->policy = HASH_POLICY_DEFAULT;
+	obj->grow = 1;
+	obj->shard_bits = bits;
+	obj->shard = (HashKv**)(obj + 1);
+	for(i = 0; i < (1U << bits); i++)
+	{
+		obj->shard[i] = hash_NewEx(tab_len, engine);
+		if(!obj->shard[i])
+			goto err;
+		obj->shard[i]->shard_id = i;
+	}
+	return (HashKv_t)obj;
+err:
+	while(i--)
+		hash_Del(obj->shard[i]);
+	FREE(obj);
+	return NULL;
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_New
+ 功能描述  : 
+ 	新建一个hash表,使用拉链法存储引擎
+ 参数：
+ 	tab_len hash表的初始长度，会向上取整为2的幂,装载率过高时自动扩容
+ 返回值：
+ 	成功返回哈希表对象，失败返回NULL
+*****************************************************************************/
+HashKv_t hash_New(uint32_t tab_len)
+{
+	return hash_NewEx(tab_len, HASH_ENGINE_CHAIN);
+}
+
+
+/* ############################## 表镜像 ############################# */
+
+#if HASH_KV_USE_IMAGE
+/* 遍历一个分片中的所有数据项,调用者需已持有锁 */
+static void _ItemForEach(HashKv *ht,void (*fn)(void *param,HashItem *data_item),void *param)
+{
+	HashTab		*t;
+	HashItem	*data_item;
+	uint32_t	i;
+	int			n;
+
+	for(n = 0; n < 2; n++)
+	{
+		t = &ht->tab[n];
+		for(i = 0; i < t->len; i++)
+		{
+			if(ht->engine == HASH_ENGINE_OPEN)
+			{
+				if(t->tag[i] > HASH_TAG_TOMB)
+					fn(param, t->slot[i]);
+				continue;
+			}
+			list_for_each_entry(data_item, &t->head[i].head, list)
+				fn(param, data_item);
+		}
+	}
+}
+
+typedef struct _HashImageBuild{
+	uint8_t		*image;
+	uint64_t	off;			/* 下一个数据项的写入位置,统计阶段为总字节数 */
+	uint32_t	num;
+	uint32_t	len;
+}HashImageBuild;
+
+static void _ImageCount(void *param,HashItem *data_item)
+{
+	HashImageBuild *ib = param;
+	ib->off += _ImageItemSize(data_item->k_len, data_item->v_len);
+	ib->num++;
+}
+
+static void _ImagePut(void *param,HashItem *data_item)
+{
+	HashImageBuild	*ib = param;
+	uint32_t		*bucket = (uint32_t*)(ib->image + sizeof(HashImageHead));
+	HashImageItem	*e = (HashImageItem*)(ib->image + ib->off);
+	uint32_t		b = _HashMix(data_item->hash) & (ib->len - 1);
+
+	e->next = bucket[b];
+	e->hash = data_item->hash;
+	e->k_len = data_item->k_len;
+	e->v_len = data_item->v_len;
+	memcpy(e->k, data_item->k, data_item->k_len + 1);
+	memcpy((uint8_t*)_ImageVal(e), data_item->v, data_item->v_len);
+	bucket[b] = (uint32_t)ib->off;
+	ib->off += _ImageItemSize(e->k_len, e->v_len);
+}
+
+/* 生成整张表的镜像,成功返回0 */
+static int _ImageBuild(HashKv *obj,uint8_t **image,uint64_t *size)
+{
+	HashKv			**shard = obj->shard ? obj->shard : &obj;
+	uint32_t		shard_num = obj->shard ? (1U << obj->shard_bits) : 1;
+	HashImageBuild	ib;
+	HashImageHead	*head;
+	uint32_t		i;
+
+	if(_LockAll(obj)) return -2;
+	memset(&ib, 0, sizeof(ib));
+	for(i = 0; i < shard_num; i++)
+		_ItemForEach(shard[i], _ImageCount, &ib);
+	ib.len = _RoundupPowOfTwo(ib.num);
+	*size = _ImageDataStart(ib.len) + ib.off;
+	/* 偏移用32位记录 */
+	if(*size > UINT32_MAX || (size_t)*size != *size)
+		goto err;
+	ib.image = MALLOC((size_t)*size);
+	if(!ib.image)
+		goto err;
+	memset(ib.image, 0, (size_t)_ImageDataStart(ib.len));
+	ib.off = _ImageDataStart(ib.len);
+	for(i = 0; i < shard_num; i++)
+		_ItemForEach(shard[i], _ImagePut, &ib);
+	_UnlockAll(obj);
+
+	head = (HashImageHead*)ib.image;
+	head->magic = HASH_IMAGE_MAGIC;
+	head->version = HASH_IMAGE_VERSION;
+	head->policy = obj->policy;
+	head->len = ib.len;
+	head->num = ib.num;
+	head->size = *size;
+	head->crc = crc32(0, ib.image + sizeof(HashImageHead), (uint32_t)(*size - sizeof(HashImageHead)));
+	*image = ib.image;
+	return 0;
+err:
+	_UnlockAll(obj);
+	return -1;
+}
+
+/* 校验镜像,并检查所有偏移都在镜像范围内,通过后查找时不再做边界检查 */
+static int _ImageCheck(const uint8_t *image,uint64_t size)
+{
+	const HashImageHead	*head = (const HashImageHead*)image;
+	const uint32_t		*bucket = (const uint32_t*)(head + 1);
+	const HashImageItem	*e;
+	uint64_t			start;
+	uint32_t			i, off, num = 0;
+
+	if(size < sizeof(HashImageHead) || size > UINT32_MAX) return -1;
+	if(head->magic != HASH_IMAGE_MAGIC || head->version != HASH_IMAGE_VERSION) return -1;
+	if(head->size != size || head->policy > HASH_POLICY_WY) return -1;
+	if(head->len == 0 || (head->len & (head->len - 1))) return -1;
+	start = _ImageDataStart(head->len);
+	if(start > size) return -1;
+	if(crc32(0, image + sizeof(HashImageHead), (uint32_t)(size - sizeof(HashImageHead))) != head->crc)
+		return -1;
+	for(i = 0; i < head->len; i++)
+	{
+		for(off = bucket[i]; off; off = e->next)
+		{
+			if(off < start || (off & 7) || off + sizeof(HashImageItem) > size)
+				return -1;
+			e = (const HashImageItem*)(image + off);
+			if(off + _ImageItemSize(e->k_len, e->v_len) > size || e->k[e->k_len] != '\0')
+				return -1;
+			if((_HashMix(e->hash) & (head->len - 1)) != i || e->next >= off)
+				return -1;
+			num++;
+		}
+	}
+	return num == head->num ? 0 : -1;
+}
+#endif
+
+/*****************************************************************************
+ 函 数 名  : hash_SaveImage
+ 功能描述  : 
+ 	把整张表保存为镜像文件,保存期间锁住所有分片
+ 	镜像按本机字节序存放,带crc32校验,可由 hash_LoadImage 加载
+ 	或由 hash_MapImage 直接映射查询
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	path		文件路径
+  返回值：
+ 	成功返回0,失败返回负数
+*****************************************************************************/
+int hash_SaveImage(HashKv_t ht,const char *path)
+{
+#if HASH_KV_USE_IMAGE
+	HashKv		*obj = (HashKv*)ht;
+	uint8_t		*image;
+	uint64_t	size;
+	FILE		*fp;
+	int			ret;
+
+	if(!obj || !path) return -1;
+	if(_IsImage(obj)) return -1;
+	ret = _ImageBuild(obj, &image, &size);
+	if(ret) return ret;
+	ret = -3;
+	fp = fopen(path, "wb");
+	if(fp)
+	{
+		if(fwrite(image, 1, (size_t)size, fp) == size)
+			ret = 0;
+		if(fclose(fp))
+			ret = -3;
+	}
+	FREE(image);
+	return ret;
+#else
+	(void)ht;
+	(void)path;
+	return -1;
+#endif
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_LoadImage
+ 功能描述  : 
+ 	把镜像文件中的数据项批量写入表中,已存在的键会被覆盖
+ 	表的哈希算法与镜像相同时直接使用镜像中的哈希值
+  参数：
+ 	ht 			由hash_New生成的HashKv_t
+ 	path		文件路径
+  返回值：
+ 	成功返回加载的数据项数量,失败返回负数
+*****************************************************************************/
+int hash_LoadImage(HashKv_t ht,const char *path)
+{
+#if HASH_KV_USE_IMAGE
+	HashKv				*obj = (HashKv*)ht;
+	const HashImageHead	*head;
+	const uint32_t		*bucket;
+	const HashImageItem	*e;
+	uint8_t				*image = NULL;
+	FILE				*fp;
+	long				size;
+	uint32_t			i, off, hash;
+	int					ret = -3;
+
+	if(!obj || !path) return -1;
+	if(_IsImage(obj)) return -1;
+	fp = fopen(path, "rb");
+	if(!fp) return -3;
+	if(fseek(fp, 0, SEEK_END) || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET))
+		goto out;
+	image = MALLOC(size ? (size_t)size : 1);
+	if(!image){
+		ret = -1;
+		goto out;
+	}
+	if(fread(image, 1, (size_t)size, fp) != (size_t)size)
+		goto out;
+	ret = -4;
+	if(_ImageCheck(image, (uint64_t)size))
+		goto out;
+
+	head = (const HashImageHead*)image;
+	bucket = (const uint32_t*)(head + 1);
+	if(_LockAll(obj)){
+		ret = -2;
+		goto out;
+	}
+	ret = 0;
+	for(i = 0; i < head->len; i++)
+	{
+		for(off = bucket[i]; off; off = e->next)
+		{
+			e = (const HashImageItem*)(image + off);
+			/* 键可能是含0的二进制键,按记录的长度重新计算 */
+			hash = head->policy == obj->policy ? e->hash : _KeyHashBin(obj, e->k, e->k_len);
+			if(_SetDataLocked(_ShardRoute(obj, hash), hash, e->k, e->k_len,
+					_ImageVal(e), e->v_len) < 0)
+				ret = -1;
+			else if(ret >= 0)
+				ret++;
+		}
+	}
+	_UnlockAll(obj);
+out:
+	if(image)
+		FREE(image);
+	fclose(fp);
+	return ret;
+#else
+	(void)ht;
+	(void)path;
+	return -1;
+#endif
+}
+
+/*****************************************************************************
+ 函 数 名  : hash_MapImage
+ 功能描述  : 
+ 	以只读方式映射镜像文件,映射后立即可以查询,不需要逐项重建
+ 	支持 hash_GetData/hash_MultiGet/hash_Iteration 与 Blob 的读操作,
+ 	所有修改操作都返回错误,由 hash_Del 解除映射
+  参数：
+ 	path		文件路径
+  返回值：
+ 	成功返回哈希表对象，失败返回NULL
+*****************************************************************************/
+HashKv_t hash_MapImage(const char *path)
+{
+#if HASH_KV_USE_IMAGE
+	HashKv		*obj;
+	struct stat	st;
+	void		*image;
+	int			fd;
+
+	if(!path) return NULL;
+	fd = open(path, O_RDONLY);
+	if(fd < 0) return NULL;
+	if(fstat(fd, &st) || st.st_size <= 0){
+		close(fd);
+		return NULL;
+	}
+	image = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(image == MAP_FAILED) return NULL;
+	if(_ImageCheck(image, (uint64_t)st.st_size))
+		goto err;
+
+	obj = MALLOC(sizeof(HashKv));
+	if(obj == NULL)
+		goto err;
+	memset(obj, 0, sizeof(HashKv));
+	obj->engine = HASH_ENGINE_CHAIN;
+	obj->policy = ((const HashImageHead*)image)->policy;
+	obj->image = image;
+	obj->image_size = (uint64_t)st.st_size;
+	return (HashKv_t)obj;
+err:
+	munmap(image, (size_t)st.st_size);
+	return NULL;
+#else
+	(void)path;
+	return NULL;
+#endif
+}
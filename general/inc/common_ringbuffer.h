@@ -24,6 +24,22 @@ extern "C"{
 #include <stdint.h>
 #include <stdbool.h>
 
+/* ######################################################################## */
+/* ################################ CONFIG ################################ */
+#define 	CRB_USE_SPSC						0	/* 读写指针带内存屏障,单生产者单消费者无需加锁,需要C11原子操作 */
+#define 	CRB_USE_FD_IO						1	/* 提供与文件描述符直接读写的接口,仅POSIX */
+/* ######################################################################## */
+/* ################################ CHECK ################################# */
+#if CRB_USE_SPSC && defined(__STDC_NO_ATOMICS__)
+#error  "CRB_USE_SPSC requires C11 atomics"
+#endif
+#if CRB_USE_FD_IO && (defined(__unix__) || defined(__APPLE__))
+#define 	CRB_FD_IO							1
+#else
+#define 	CRB_FD_IO							0
+#endif
+/* ######################################################################## */
+
 typedef int32_t er_ssize_t;
 
 typedef struct _Crb{
@@ -31,6 +47,7 @@ typedef struct _Crb{
 	uint32_t 	mem_size;	/* 环形缓冲区的大小 */
 	uint32_t 	write;		/* 环形缓冲区的写指针 */
 	uint32_t 	read;		/* 环形缓冲区的写指针 */
+	uint32_t 	mask;		/* 非0为2的幂模式: read/write为自由递增的计数,用 &mask 取下标 */
     int         is_static;   /* 环形缓冲区是否为静态存储 */
 }Crb;
 
@@ -38,6 +55,8 @@ typedef struct _Crb{
 extern void crb_Del(Crb* fifo);
 extern Crb* crb_New(uint32_t size);
 extern int crb_StaticNew(Crb* crb, uint8_t* buf, uint32_t size);
+extern Crb* crb_NewPow2(uint32_t size);
+extern int crb_StaticNewPow2(Crb* crb, uint8_t* buf, uint32_t size);
 extern uint32_t crb_Read(Crb* fifo, uint8_t *buf, uint32_t buf_size);
 extern uint32_t crb_Peep(Crb* fifo, uint8_t *buf, uint32_t buf_size);
 extern uint32_t crb_Write(Crb* fifo, const uint8_t *buf, uint32_t buf_size);
@@ -45,6 +64,13 @@ extern uint32_t crb_ReadAir(Crb* fifo, uint32_t buf_size);
 extern void crb_Clear(Crb* fifo);
 extern uint32_t crb_Size(Crb *fifo);
 extern uint32_t crb_FreeSize(Crb* fifo);
+extern er_ssize_t crb_FindByte(Crb* fifo, uint32_t start, uint8_t byte);
+extern er_ssize_t crb_FindSeq(Crb* fifo, uint32_t start, const uint8_t *seq, uint32_t seq_len);
+extern er_ssize_t crb_FindAny(Crb* fifo, uint32_t start, const uint8_t *set, uint32_t set_len);
+#if CRB_FD_IO
+extern er_ssize_t crb_ReadFromFd(Crb* fifo, int fd, uint32_t max_size);
+extern er_ssize_t crb_WriteToFd(Crb* fifo, int fd, uint32_t max_size);
+#endif
 
 
 
@@ -3,6 +3,8 @@
  * @brief
  *		环形缓冲器特殊实现，可直接在缓冲器内存上做数据解析，无需额外的拷贝和额外的缓冲区消耗。
  *		缺点是需要两倍的内存来运行。
+ *		linux下容量为页大小整数倍时,erb_New使用memfd将同一段物理内存连续映射两次,
+ *		由MMU提供镜像,既不需要两倍的内存,写入时也不再需要第二次拷贝。
  * @author simon.xiaoapeng (simon.xiaoapeng@gmail.com)
  * @version 1.0
  * @date 2021-03-01
@@ -27,6 +29,23 @@ extern "C"{
 #include <stdint.h>
 #include <stdbool.h>
 
+/* ######################################################################## */
+/* ################################ CONFIG ################################ */
+#define 	ERB_USE_MMAP_MIRROR					1	/* linux下使用memfd双重映射做镜像 */
+#define 	ERB_USE_SPSC						0	/* 读写指针带内存屏障,单生产者单消费者无需加锁,需要C11原子操作 */
+#define 	ERB_USE_FD_IO						1	/* 提供与文件描述符直接读写的接口,仅POSIX */
+/* ######################################################################## */
+/* ################################ CHECK ################################# */
+#if ERB_USE_SPSC && defined(__STDC_NO_ATOMICS__)
+#error  "ERB_USE_SPSC requires C11 atomics"
+#endif
+#if ERB_USE_FD_IO && (defined(__unix__) || defined(__APPLE__))
+#define 	ERB_FD_IO							1
+#else
+#define 	ERB_FD_IO							0
+#endif
+/* ######################################################################## */
+
 typedef int32_t er_ssize_t;
 
 typedef struct _Erb{
@@ -36,6 +55,7 @@ typedef struct _Erb{
 	uint32_t 	read;		/* 环形缓冲区的写指针 */
 	uint8_t 	*mem_tmp;	/* 某些操作使用的临时缓冲区 */
   	int         is_static;   /* 环形缓冲区是否为静态存储 */
+	int			is_mirror;	/* mem为双重映射,mem_tmp即mem的镜像 */
 }Erb;
 
 
@@ -50,6 +70,13 @@ extern const uint8_t* erb_PeepAll(Erb* fifo, uint32_t* peep_size);
 extern void erb_Clear(Erb* fifo);
 extern uint32_t erb_Size(Erb *fifo);
 extern uint32_t erb_FreeSize(Erb* fifo);
+extern er_ssize_t erb_FindByte(Erb* fifo, uint32_t start, uint8_t byte);
+extern er_ssize_t erb_FindSeq(Erb* fifo, uint32_t start, const uint8_t *seq, uint32_t seq_len);
+extern er_ssize_t erb_FindAny(Erb* fifo, uint32_t start, const uint8_t *set, uint32_t set_len);
+#if ERB_FD_IO
+extern er_ssize_t erb_ReadFromFd(Erb* fifo, int fd, uint32_t max_size);
+extern er_ssize_t erb_WriteToFd(Erb* fifo, int fd, uint32_t max_size);
+#endif
 
 
 #ifdef __cplusplus
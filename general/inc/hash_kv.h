@@ -33,8 +33,57 @@ enum HashIterState
 };
 
 
+enum HashEngine
+{
+	HASH_ENGINE_CHAIN,	/* 拉链法,每个桶一条链表 */
+	HASH_ENGINE_OPEN,	/* 开放寻址,指纹内联在连续的槽数组中,查找通常只访问一到两条缓存行 */
+};
+
+
+enum HashPolicy
+{
+	HASH_POLICY_RS,		/* 以下为逐字节处理的经典算法 */
+	HASH_POLICY_JS,
+	HASH_POLICY_PJW,
+	HASH_POLICY_ELF,
+	HASH_POLICY_BKDR,
+	HASH_POLICY_SDBM,
+	HASH_POLICY_DJB,
+	HASH_POLICY_DEK,
+	HASH_POLICY_BP,
+	HASH_POLICY_FNV,
+	HASH_POLICY_AP,
+	HASH_POLICY_WY,		/* 按字处理(wyhash风格),求长度与哈希合并为一趟 */
+};
+
+
+enum HashWatchEvent
+{
+	HASH_WATCH_SET,			/* 键被写入或新建 */
+	HASH_WATCH_DEL,			/* 键被删除,包括过期与淘汰 */
+	HASH_WATCH_OVERFLOW,	/* 队列满丢失了事件,需要重新读取所有关注的键 */
+};
+
+
 typedef void* HashKv_t;
 typedef struct{void*a;void*b;} HashBlob_t;
+typedef struct{void*a;uint64_t b;uint32_t c;} HashScan_t;
+
+typedef struct{
+	uint64_t	used;		/* 数据项与值实际占用的字节数 */
+	uint64_t	wasted;		/* 按尺寸类取整浪费的字节数 */
+	uint64_t	idle;		/* slab页中尚未分配出去的字节数,包括空闲链表 */
+	uint64_t	slab;		/* 向系统申请的slab页总字节数 */
+	uint64_t	large;		/* 超过最大尺寸类,直接MALLOC的字节数 */
+	uint32_t	inline_val;	/* 直接存放在数据项中的值的数量 */
+} HashMemStats;
+
+typedef struct{
+	uint64_t	hit;		/* 读操作命中次数 */
+	uint64_t	miss;		/* 读操作未命中次数,包括已过期的键 */
+	uint64_t	evicted;	/* 因超出内存上限被淘汰的数量 */
+	uint64_t	expired;	/* 因过期被删除的数量 */
+} HashCacheStats;
 
 /* Blob 操作 性能高 */
 extern int		hash_ReleaseBlob(HashBlob_t *b);
@@ -42,6 +91,9 @@ extern int		hash_AcquireBlob(HashKv_t ht, HashBlob_t *b,char* k);
 extern int		hash_DelKeyFormBlob(HashBlob_t *b);
 extern int		hash_BlobGetData(HashBlob_t * b, void * buf, uint32_t read_len);
 extern int		hash_BlobSetData(HashBlob_t *b,const void* data,uint32_t data_len);
+extern int		hash_BlobGetView(HashBlob_t *b,const void **data,uint32_t *len);
+extern int		hash_BlobPutView(HashBlob_t *b);
+extern int		hash_BlobMutate(HashBlob_t *b,int (*mutator)(void* param,void* data,uint32_t len),void *param);
 
 static inline int  hash_BlobSetString(HashBlob_t *b, char* string)
 {
@@ -49,25 +101,77 @@ static inline int  hash_BlobSetString(HashBlob_t *b, char* string)
 }
 
 extern const char* hash_BlobGetKey(HashBlob_t *b);
+extern const void* hash_BlobGetKeyBin(HashBlob_t *b,uint32_t *key_len);
 
 /* key 操作 */
 extern void 	hash_SetLock(HashKv_t ht,int (*lock)(void),void (*unlock)(void));
+extern void 	hash_SetAutoResize(HashKv_t ht,int grow,int shrink);
+extern void 	hash_SetShardLock(HashKv_t ht,int (*lock)(uint32_t shard),void (*unlock)(uint32_t shard));
+extern uint32_t hash_GetShardNum(HashKv_t ht);
+extern int		hash_SetHashPolicy(HashKv_t ht,enum HashPolicy policy);
+extern int		hash_SetReadMostly(HashKv_t ht);
+extern int		hash_GetMemStats(HashKv_t ht,HashMemStats *st);
+extern int		hash_SetMemBudget(HashKv_t ht,uint64_t bytes);
+extern int		hash_GetCacheStats(HashKv_t ht,HashCacheStats *st);
+extern int		hash_Expire(HashKv_t ht,const char* k,uint32_t ttl);
+extern int		hash_SetDataTTL(HashKv_t ht,const char* k,const void* data,uint32_t data_len,uint32_t ttl);
+extern int		hash_Sweep(HashKv_t ht,uint32_t steps);
 extern int		hash_SetData(HashKv_t ht,const char* k,const void* data,uint32_t data_len);
 extern int		hash_GetData(HashKv_t ht,const char* k,void* buf,uint32_t read_size);
+extern uint32_t hash_KeyHash(HashKv_t ht,const char* k,uint32_t *len);
+extern int		hash_GetDataHashed(HashKv_t ht,const char* k,uint32_t len,uint32_t hash,
+						void* buf,uint32_t read_size);
 extern int		hash_NewData(HashKv_t ht,const char* k,uint32_t data_len);
 extern int		hash_DelKey(HashKv_t ht,const char* k);
+/* 二进制键与整数键,内容相同的键与字符串键是同一个键 */
+extern uint32_t hash_KeyHashBin(HashKv_t ht,const void* key,uint32_t key_len);
+extern int		hash_SetDataBin(HashKv_t ht,const void* key,uint32_t key_len,const void* data,uint32_t data_len);
+extern int		hash_GetDataBin(HashKv_t ht,const void* key,uint32_t key_len,void* buf,uint32_t read_size);
+extern int		hash_DelKeyBin(HashKv_t ht,const void* key,uint32_t key_len);
+extern int		hash_AcquireBlobBin(HashKv_t ht,HashBlob_t *b,const void* key,uint32_t key_len);
+extern int		hash_SetDataU32(HashKv_t ht,uint32_t key,const void* data,uint32_t data_len);
+extern int		hash_GetDataU32(HashKv_t ht,uint32_t key,void* buf,uint32_t read_size);
+extern int		hash_DelKeyU32(HashKv_t ht,uint32_t key);
+extern int		hash_SetDataU64(HashKv_t ht,uint64_t key,const void* data,uint32_t data_len);
+extern int		hash_GetDataU64(HashKv_t ht,uint64_t key,void* buf,uint32_t read_size);
+extern int		hash_DelKeyU64(HashKv_t ht,uint64_t key);
+extern int		hash_MultiGet(HashKv_t ht,uint32_t n,const char **k,void **buf,
+						const uint32_t *read_size,int *status);
+extern int		hash_MultiSet(HashKv_t ht,uint32_t n,const char **k,const void **data,
+						const uint32_t *data_len,int *status);
+extern int		hash_MultiDel(HashKv_t ht,uint32_t n,const char **k,int *status);
+extern int		hash_ParallelSet(HashKv_t ht,uint32_t threads,uint32_t n,const char **k,
+						const void **data,const uint32_t *data_len,int *status);
 static inline int  hash_SetString(HashKv_t ht,const char* k, char* string)
 {
 	return hash_SetData(ht, k, string, strlen(string)+1);
 }
 /* 迭代器 */
 extern int hash_Iteration(HashKv_t ht, enum HashIterState (*processor)(void* param,HashBlob_t* ),void *param);
+extern int hash_ScanStart(HashKv_t ht,HashScan_t *s);
+extern int hash_ScanNext(HashScan_t *s,HashBlob_t *b,uint32_t count);
+extern int hash_ParallelForEach(HashKv_t ht,uint32_t threads,
+				enum HashIterState (*fn)(void *param,uint32_t worker,const void *k,uint32_t k_len,
+							const void *data,uint32_t data_len),void *param);
 
 
 /* 哈希表创建与销毁 */
 extern HashKv_t hash_New(uint32_t tab_len);
+extern HashKv_t hash_NewEx(uint32_t tab_len, enum HashEngine engine);
+extern HashKv_t hash_NewSharded(uint32_t tab_len, enum HashEngine engine, uint32_t shard_num);
 extern void 	hash_Del(HashKv_t ht);
 
+/* 变更通知 */
+extern int		hash_Watch(HashKv_t ht,const void* key,uint32_t key_len,int prefix);
+extern int		hash_Unwatch(HashKv_t ht,const void* key,uint32_t key_len,int prefix);
+extern int		hash_WatchDrain(HashKv_t ht,uint32_t max,
+						void (*fn)(void *param,enum HashWatchEvent ev,const void *k,uint32_t k_len),void *param);
+
+/* 表镜像 */
+extern int		hash_SaveImage(HashKv_t ht,const char *path);
+extern int		hash_LoadImage(HashKv_t ht,const char *path);
+extern HashKv_t hash_MapImage(const char *path);
+
 
 
 
@@ -23,6 +23,11 @@
 /* ################################ CONFIG ################################ */
 #define 	PFIFO_USE_PLATFORM_LINUX			1
 #define 	PFIFO_USE_PLATFORM_ONSYS			0
+#define 	PFIFO_CACHE_LINE					64	/* 生产者与消费者的索引分开放在不同的缓存行 */
+#ifndef PFIFO_USE_SPSC_CACHE
+#define 	PFIFO_USE_SPSC_CACHE				0	/* in/out分开存放,并各自缓存对方的索引,struct __pfifo 由24字节增大到144字节 */
+#endif
+#define 	PFIFO_USE_WAIT						PFIFO_USE_PLATFORM_LINUX	/* 可阻塞等待的pfifo,基于futex/eventfd,仅linux */
 
 /* ######################################################################## */
 /* ################################ CHECK ################################# */
@@ -34,6 +39,8 @@
 
 #include <stdatomic.h>
 #define __pfifo_smp_wmb() 			atomic_thread_fence(memory_order_release)
+#define __pfifo_smp_rmb() 			atomic_thread_fence(memory_order_acquire)
+#define __PFIFO_READ_ONCE(x)		(*(volatile typeof(x) *)&(x))
 
 
 
@@ -64,9 +71,23 @@
 
 
 
+/*
+ * With PFIFO_USE_SPSC_CACHE the producer side (in, out_cache) and the
+ * consumer side (out, in_cache) sit a cache line apart, and each side only
+ * re-reads the other's index when its cached copy says the fifo is full
+ * or empty.
+ */
 struct __pfifo {
 	unsigned int			in;
+#if PFIFO_USE_SPSC_CACHE
+	unsigned int			out_cache;
+	unsigned char			__pad_in[PFIFO_CACHE_LINE - 2 * sizeof(unsigned int)];
+#endif
 	unsigned int			out;
+#if PFIFO_USE_SPSC_CACHE
+	unsigned int			in_cache;
+	unsigned char			__pad_out[PFIFO_CACHE_LINE - 2 * sizeof(unsigned int)];
+#endif
 	unsigned int			mask;
 	unsigned int			esize;
 	void					*data;
@@ -111,17 +132,23 @@ struct pfifo __STRUCT_PFIFO_PTR(unsigned char, 0, void);
 #define STRUCT_PFIFO_REC_2(size) \
 	struct __STRUCT_PFIFO(unsigned char, size, 2, void)
 
+#define STRUCT_PFIFO_REC_4(size) \
+	struct __STRUCT_PFIFO(unsigned char, size, 4, void)
+
 /*
  * define pfifo_rec types
  */
 struct pfifo_rec_ptr_1 __STRUCT_PFIFO_PTR(unsigned char, 1, void);
 struct pfifo_rec_ptr_2 __STRUCT_PFIFO_PTR(unsigned char, 2, void);
+struct pfifo_rec_ptr_4 __STRUCT_PFIFO_PTR(unsigned char, 4, void);
 
 /**
  * 返回值的定义
  */
 #define PFIFO_EINVAL			(-1)
 #define PFIFO_ENOMEM			(-2)
+#define PFIFO_ETIMEDOUT			(-3)
+#define PFIFO_ESYS				(-4)
 
 
 /*
@@ -155,8 +182,7 @@ struct pfifo_rec_ptr_2 __STRUCT_PFIFO_PTR(unsigned char, 2, void);
 (void)({ \
 	typeof(&(fifo)) __tmp = &(fifo); \
 	struct __pfifo *__pfifo = &__tmp->pfifo; \
-	__pfifo->in = 0; \
-	__pfifo->out = 0; \
+	__pfifo_reset_cache(__pfifo, 0); \
 	__pfifo->mask = __is_pfifo_ptr(__tmp) ? 0 : PFIFO_ARRAY_SIZE(__tmp->buf) - 1;\
 	__pfifo->esize = sizeof(*__tmp->buf); \
 	__pfifo->data = __is_pfifo_ptr(__tmp) ?  NULL : __tmp->buf; \
@@ -187,6 +213,70 @@ struct pfifo_rec_ptr_2 __STRUCT_PFIFO_PTR(unsigned char, 2, void);
 	}
 	
 
+static inline void __pfifo_set_in_cache(struct __pfifo *fifo, unsigned int in)
+{
+#if PFIFO_USE_SPSC_CACHE
+	fifo->in_cache = in;
+#else
+	(void)fifo;
+	(void)in;
+#endif
+}
+
+static inline void __pfifo_reset_cache(struct __pfifo *fifo, unsigned int pos)
+{
+	fifo->in = fifo->out = pos;
+#if PFIFO_USE_SPSC_CACHE
+	fifo->in_cache = fifo->out_cache = pos;
+#endif
+}
+
+/*
+ * producer side: returns the number of unused elements, the consumer's
+ * index is only loaded when the cached one leaves less than @need
+ */
+static inline unsigned int __pfifo_prod_avail(struct __pfifo *fifo, unsigned int need)
+{
+#if PFIFO_USE_SPSC_CACHE
+	unsigned int unused = (fifo->mask + 1) - (fifo->in - fifo->out_cache);
+
+	if (unused >= need)
+		return unused;
+	fifo->out_cache = __PFIFO_READ_ONCE(fifo->out);
+	__pfifo_smp_rmb();
+	return (fifo->mask + 1) - (fifo->in - fifo->out_cache);
+#else
+	unsigned int out = __PFIFO_READ_ONCE(fifo->out);
+
+	(void)need;
+	__pfifo_smp_rmb();
+	return (fifo->mask + 1) - (fifo->in - out);
+#endif
+}
+
+/*
+ * consumer side: returns the number of used elements, the producer's
+ * index is only loaded when the cached one shows less than @need
+ */
+static inline unsigned int __pfifo_cons_avail(struct __pfifo *fifo, unsigned int need)
+{
+#if PFIFO_USE_SPSC_CACHE
+	unsigned int used = fifo->in_cache - fifo->out;
+
+	if (used >= need)
+		return used;
+	fifo->in_cache = __PFIFO_READ_ONCE(fifo->in);
+	__pfifo_smp_rmb();
+	return fifo->in_cache - fifo->out;
+#else
+	unsigned int in = __PFIFO_READ_ONCE(fifo->in);
+
+	(void)need;
+	__pfifo_smp_rmb();
+	return in - fifo->out;
+#endif
+}
+
 static inline unsigned int __pfifo_uint_must_check_helper(unsigned int val)
 {
 	return val;
@@ -236,7 +326,7 @@ static inline int __pfifo_int_must_check_helper(int val)
 #define pfifo_reset(fifo) \
 (void)({ \
 	typeof((fifo) + 1) __tmp = (fifo); \
-	__tmp->pfifo.in = __tmp->pfifo.out = 0; \
+	__pfifo_reset_cache(&__tmp->pfifo, 0); \
 })
 
 /**
@@ -251,6 +341,7 @@ static inline int __pfifo_int_must_check_helper(int val)
 (void)({ \
 	typeof((fifo) + 1) __tmp = (fifo); \
 	__tmp->pfifo.out = __tmp->pfifo.in; \
+	__pfifo_set_in_cache(&__tmp->pfifo, __tmp->pfifo.in); \
 })
 
 /**
@@ -409,7 +500,7 @@ __pfifo_int_must_check_helper( \
 		__ret = __pfifo_in_r(__pfifo, &__val, sizeof(__val), \
 			__recsize); \
 	else { \
-		__ret = !pfifo_is_full(__tmp); \
+		__ret = __pfifo_prod_avail(__pfifo, 1) != 0; \
 		if (__ret) { \
 			(__is_pfifo_ptr(__tmp) ? \
 			((typeof(__tmp->type))__pfifo->data) : \
@@ -447,7 +538,7 @@ __pfifo_uint_must_check_helper( \
 		__ret = __pfifo_out_r(__pfifo, __val, sizeof(*__val), \
 			__recsize); \
 	else { \
-		__ret = !pfifo_is_empty(__tmp); \
+		__ret = __pfifo_cons_avail(__pfifo, 1) != 0; \
 		if (__ret) { \
 			*(typeof(__tmp->type))__val = \
 				(__is_pfifo_ptr(__tmp) ? \
@@ -486,7 +577,7 @@ __pfifo_uint_must_check_helper( \
 		__ret = __pfifo_out_peek_r(__pfifo, __val, sizeof(*__val), \
 			__recsize); \
 	else { \
-		__ret = !pfifo_is_empty(__tmp); \
+		__ret = __pfifo_cons_avail(__pfifo, 1) != 0; \
 		if (__ret) { \
 			*(typeof(__tmp->type))__val = \
 				(__is_pfifo_ptr(__tmp) ? \
@@ -578,6 +669,266 @@ __pfifo_uint_must_check_helper( \
 }) \
 )
 
+/**
+ * struct pfifo_span - up to two contiguous pieces of fifo memory
+ * @buf: start of each piece, buf[1] is NULL when the span does not wrap
+ * @len: length of each piece in elements (bytes for record fifos)
+ */
+struct pfifo_span {
+	void			*buf[2];
+	unsigned int	len[2];
+};
+
+/**
+ * struct pfifo_iov - one record for the bulk record operations
+ * @buf: record data
+ * @len: record length in bytes
+ */
+struct pfifo_iov {
+	void			*buf;
+	unsigned int	len;
+};
+
+/**
+ * pfifo_in_reserve - reserve fifo memory to be filled in place
+ * @fifo: address of the fifo to be used
+ * @span: receives the writable memory
+ * @n: number of elements wanted
+ *
+ * Returns the number of elements reserved, which may be less than @n when
+ * the fifo is nearly full. A record fifo reserves room for a whole record
+ * of @n bytes or nothing at all, and the span only covers the payload.
+ * Nothing is visible to the reader until pfifo_in_commit().
+ *
+ * Note that with only one concurrent reader and one concurrent
+ * writer, you don't need extra locking to use these macro.
+ */
+#define	pfifo_in_reserve(fifo, span, n) \
+__pfifo_uint_must_check_helper( \
+({ \
+	typeof((fifo) + 1) __tmp = (fifo); \
+	struct pfifo_span *__span = (span); \
+	unsigned long __n = (n); \
+	const size_t __recsize = sizeof(*__tmp->rectype); \
+	struct __pfifo *__pfifo = &__tmp->pfifo; \
+	(__recsize) ? \
+	__pfifo_in_reserve_r(__pfifo, __span, __n, __recsize) : \
+	__pfifo_in_reserve(__pfifo, __span, __n); \
+}) \
+)
+
+/**
+ * pfifo_in_commit - publish memory filled after pfifo_in_reserve()
+ * @fifo: address of the fifo to be used
+ * @n: number of elements written, not more than reserved
+ *
+ * For a record fifo @n is the final length of the record, so a producer
+ * may reserve for the largest record and commit the decoded length.
+ */
+#define	pfifo_in_commit(fifo, n) \
+(void)({ \
+	typeof((fifo) + 1) __tmp = (fifo); \
+	unsigned long __n = (n); \
+	const size_t __recsize = sizeof(*__tmp->rectype); \
+	struct __pfifo *__pfifo = &__tmp->pfifo; \
+	(__recsize) ? \
+	__pfifo_in_commit_r(__pfifo, __n, __recsize) : \
+	__pfifo_in_commit(__pfifo, __n); \
+})
+
+/**
+ * pfifo_out_reserve - access fifo data in place
+ * @fifo: address of the fifo to be used
+ * @span: receives the readable memory
+ * @n: max. number of elements, ignored for record fifos
+ *
+ * Returns the number of elements available in @span. A record fifo
+ * always returns the whole next record. The data stays in the fifo
+ * until pfifo_out_commit().
+ *
+ * Note that with only one concurrent reader and one concurrent
+ * writer, you don't need extra locking to use these macro.
+ */
+#define	pfifo_out_reserve(fifo, span, n) \
+__pfifo_uint_must_check_helper( \
+({ \
+	typeof((fifo) + 1) __tmp = (fifo); \
+	struct pfifo_span *__span = (span); \
+	unsigned long __n = (n); \
+	const size_t __recsize = sizeof(*__tmp->rectype); \
+	struct __pfifo *__pfifo = &__tmp->pfifo; \
+	(__recsize) ? \
+	__pfifo_out_reserve_r(__pfifo, __span, __recsize) : \
+	__pfifo_out_reserve(__pfifo, __span, __n); \
+}) \
+)
+
+/**
+ * pfifo_out_commit - release data consumed after pfifo_out_reserve()
+ * @fifo: address of the fifo to be used
+ * @n: number of elements consumed, ignored for record fifos
+ */
+#define	pfifo_out_commit(fifo, n) \
+(void)({ \
+	typeof((fifo) + 1) __tmp = (fifo); \
+	unsigned long __n = (n); \
+	const size_t __recsize = sizeof(*__tmp->rectype); \
+	struct __pfifo *__pfifo = &__tmp->pfifo; \
+	(__recsize) ? \
+	__pfifo_out_commit_r(__pfifo, __recsize) : \
+	__pfifo_out_commit(__pfifo, __n); \
+})
+
+/**
+ * pfifo_in_bulk - put several records into a record fifo
+ * @fifo: address of the fifo to be used
+ * @iov: the records to be added
+ * @n: number of records
+ *
+ * Records are added in order until one does not fit, all of them become
+ * visible to the reader at once. Returns the number of records added,
+ * always 0 for a fifo without records.
+ *
+ * Note that with only one concurrent reader and one concurrent
+ * writer, you don't need extra locking to use these macro.
+ */
+#define	pfifo_in_bulk(fifo, iov, n) \
+({ \
+	typeof((fifo) + 1) __tmp = (fifo); \
+	const struct pfifo_iov *__iov = (iov); \
+	unsigned int __n = (n); \
+	const size_t __recsize = sizeof(*__tmp->rectype); \
+	struct __pfifo *__pfifo = &__tmp->pfifo; \
+	(__recsize) ? \
+	__pfifo_in_bulk_r(__pfifo, __iov, __n, __recsize) : 0; \
+})
+
+/**
+ * pfifo_out_bulk - get several records from a record fifo
+ * @fifo: address of the fifo to be used
+ * @iov: @iov[i].buf and @iov[i].len give the storage for record i, on
+ *       return @iov[i].len holds the number of bytes copied
+ * @n: max. number of records to get
+ * @max_bytes: stop before the record that takes the payload over this
+ *             many bytes, 0 for no limit. The first record is always taken.
+ *
+ * A record longer than its buffer is truncated and removed as a whole,
+ * as with pfifo_out(). Returns the number of records removed, always 0
+ * for a fifo without records.
+ *
+ * Note that with only one concurrent reader and one concurrent
+ * writer, you don't need extra locking to use these macro.
+ */
+#define	pfifo_out_bulk(fifo, iov, n, max_bytes) \
+__pfifo_uint_must_check_helper( \
+({ \
+	typeof((fifo) + 1) __tmp = (fifo); \
+	struct pfifo_iov *__iov = (iov); \
+	unsigned int __n = (n); \
+	unsigned int __max = (max_bytes); \
+	const size_t __recsize = sizeof(*__tmp->rectype); \
+	struct __pfifo *__pfifo = &__tmp->pfifo; \
+	(__recsize) ? \
+	__pfifo_out_bulk_r(__pfifo, __iov, __n, __max, __recsize) : 0; \
+}) \
+)
+
+/**
+ * pfifo_out_reserve_bulk - access several records in place
+ * @fifo: address of the fifo to be used
+ * @span: receives the payload of each record
+ * @n: max. number of records
+ * @max_bytes: payload limit as for pfifo_out_bulk(), 0 for no limit
+ *
+ * Returns the number of records described in @span. They stay in the
+ * fifo until pfifo_out_commit_bulk().
+ *
+ * Note that with only one concurrent reader and one concurrent
+ * writer, you don't need extra locking to use these macro.
+ */
+#define	pfifo_out_reserve_bulk(fifo, span, n, max_bytes) \
+__pfifo_uint_must_check_helper( \
+({ \
+	typeof((fifo) + 1) __tmp = (fifo); \
+	struct pfifo_span *__span = (span); \
+	unsigned int __n = (n); \
+	unsigned int __max = (max_bytes); \
+	const size_t __recsize = sizeof(*__tmp->rectype); \
+	struct __pfifo *__pfifo = &__tmp->pfifo; \
+	(__recsize) ? \
+	__pfifo_out_reserve_bulk_r(__pfifo, __span, __n, __max, __recsize) : 0; \
+}) \
+)
+
+/**
+ * pfifo_out_commit_bulk - release records accessed by pfifo_out_reserve_bulk()
+ * @fifo: address of the fifo to be used
+ * @span: the spans filled by pfifo_out_reserve_bulk()
+ * @n: number of leading records to release, not more than reserved
+ */
+#define	pfifo_out_commit_bulk(fifo, span, n) \
+(void)({ \
+	typeof((fifo) + 1) __tmp = (fifo); \
+	const struct pfifo_span *__span = (span); \
+	unsigned int __n = (n); \
+	const size_t __recsize = sizeof(*__tmp->rectype); \
+	struct __pfifo *__pfifo = &__tmp->pfifo; \
+	if (__recsize) \
+		__pfifo_out_commit_bulk_r(__pfifo, __span, __n, __recsize); \
+})
+
+#if PFIFO_USE_PLATFORM_LINUX
+/**
+ * pfifo_in_fd - read from a file descriptor straight into the fifo
+ * @fifo: address of a byte fifo, record fifos are not supported
+ * @fd: the file descriptor
+ * @n: max. number of bytes to read
+ *
+ * The free space is handed to readv() as at most two pieces, so the data
+ * is copied once by the kernel. Returns the number of bytes read, 0 on end
+ * of file or when the fifo is full, PFIFO_ESYS with errno set on error or
+ * PFIFO_EINVAL for a fifo that does not hold bytes.
+ *
+ * Note that with only one concurrent reader and one concurrent
+ * writer, you don't need extra locking to use these macro.
+ */
+#define	pfifo_in_fd(fifo, fd, n) \
+__pfifo_int_must_check_helper( \
+({ \
+	typeof((fifo) + 1) __tmp = (fifo); \
+	const size_t __recsize = sizeof(*__tmp->rectype); \
+	(__recsize) ? PFIFO_EINVAL : \
+	__pfifo_in_fd(&__tmp->pfifo, (fd), (n)); \
+}) \
+)
+
+/**
+ * pfifo_out_fd - write fifo data straight to a file descriptor
+ * @fifo: address of a byte fifo, record fifos are not supported
+ * @fd: the file descriptor
+ * @n: max. number of bytes to write
+ *
+ * Returns the number of bytes written and removed from the fifo, 0 when it
+ * is empty, PFIFO_ESYS with errno set on error or PFIFO_EINVAL for a fifo
+ * that does not hold bytes.
+ *
+ * Note that with only one concurrent reader and one concurrent
+ * writer, you don't need extra locking to use these macro.
+ */
+#define	pfifo_out_fd(fifo, fd, n) \
+__pfifo_int_must_check_helper( \
+({ \
+	typeof((fifo) + 1) __tmp = (fifo); \
+	const size_t __recsize = sizeof(*__tmp->rectype); \
+	(__recsize) ? PFIFO_EINVAL : \
+	__pfifo_out_fd(&__tmp->pfifo, (fd), (n)); \
+}) \
+)
+
+extern int __pfifo_in_fd(struct __pfifo *fifo, int fd, unsigned int len);
+extern int __pfifo_out_fd(struct __pfifo *fifo, int fd, unsigned int len);
+#endif
+
 extern int __pfifo_alloc(struct __pfifo *fifo, unsigned int size, size_t esize);
 extern void __pfifo_free(struct __pfifo *fifo);
 extern int __pfifo_init(struct __pfifo *fifo, void *buffer, unsigned int size, size_t esize);
@@ -590,6 +941,402 @@ extern unsigned int __pfifo_len_r(struct __pfifo *fifo, size_t recsize);
 extern void __pfifo_skip_r(struct __pfifo *fifo, size_t recsize);
 extern unsigned int __pfifo_out_peek_r(struct __pfifo *fifo, void *buf, unsigned int len, size_t recsize);
 extern unsigned int __pfifo_max_r(unsigned int len, size_t recsize);
+extern unsigned int __pfifo_in_reserve(struct __pfifo *fifo, struct pfifo_span *span, unsigned int len);
+extern void __pfifo_in_commit(struct __pfifo *fifo, unsigned int len);
+extern unsigned int __pfifo_out_reserve(struct __pfifo *fifo, struct pfifo_span *span, unsigned int len);
+extern void __pfifo_out_commit(struct __pfifo *fifo, unsigned int len);
+extern unsigned int __pfifo_in_reserve_r(struct __pfifo *fifo, struct pfifo_span *span, unsigned int len, size_t recsize);
+extern void __pfifo_in_commit_r(struct __pfifo *fifo, unsigned int len, size_t recsize);
+extern unsigned int __pfifo_out_reserve_r(struct __pfifo *fifo, struct pfifo_span *span, size_t recsize);
+extern void __pfifo_out_commit_r(struct __pfifo *fifo, size_t recsize);
+extern unsigned int __pfifo_in_bulk_r(struct __pfifo *fifo, const struct pfifo_iov *iov,
+								unsigned int n, size_t recsize);
+extern unsigned int __pfifo_out_bulk_r(struct __pfifo *fifo, struct pfifo_iov *iov, unsigned int n,
+								unsigned int max_bytes, size_t recsize);
+extern unsigned int __pfifo_out_reserve_bulk_r(struct __pfifo *fifo, struct pfifo_span *span, unsigned int n,
+								unsigned int max_bytes, size_t recsize);
+extern void __pfifo_out_commit_bulk_r(struct __pfifo *fifo, const struct pfifo_span *span, unsigned int n,
+								size_t recsize);
+
+
+#if PFIFO_USE_WAIT
+/* ######################################################################## */
+/* ########################### waitable pfifo ############################# */
+
+/*
+ * Sleep/wake state kept next to a single producer / single consumer pfifo.
+ * The reader sleeps on rd_seq until data arrives and the writer on wr_seq
+ * until room is freed. The other side only enters the kernel when the
+ * parked counters say somebody is actually asleep, so a busy fifo never
+ * costs a syscall.
+ *
+ * With an eventfd the reader may instead wait in poll()/epoll together with
+ * other descriptors, see pfifo_wait_poll_begin().
+ */
+struct pfifo_wait {
+	atomic_uint				rd_seq;
+	atomic_int				rd_parked;
+	atomic_int				rd_polled;
+	atomic_uint				wr_seq;
+	atomic_int				wr_parked;
+	int						efd;
+};
+
+#define PFIFO_WAIT_INITIALIZER	{ .efd = -1 }
+
+extern void __pfifo_wake_reader(struct pfifo_wait *w);
+extern void __pfifo_wake_writer(struct pfifo_wait *w);
+
+/**
+ * pfifo_wait_fd - returns the eventfd of the waiter, -1 if it has none
+ * @w: the waiter
+ *
+ * The descriptor becomes readable when data is put into a fifo whose
+ * reader is inside pfifo_wait_poll_begin()/pfifo_wait_poll_end().
+ */
+#define pfifo_wait_fd(w)	((w)->efd)
+
+/**
+ * pfifo_wake_reader - producer side notify after putting data
+ * @w: the waiter of the fifo
+ *
+ * Call after pfifo_put(), pfifo_in() or pfifo_in_commit(). Costs a fence
+ * and a load unless the reader is parked.
+ */
+static inline void pfifo_wake_reader(struct pfifo_wait *w)
+{
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(&w->rd_parked, memory_order_relaxed) ||
+		atomic_load_explicit(&w->rd_polled, memory_order_relaxed))
+		__pfifo_wake_reader(w);
+}
+
+/**
+ * pfifo_wake_writer - consumer side notify after taking data
+ * @w: the waiter of the fifo
+ *
+ * Call after pfifo_get(), pfifo_out() or pfifo_out_commit(). Costs a fence
+ * and a load unless the writer is parked.
+ */
+static inline void pfifo_wake_writer(struct pfifo_wait *w)
+{
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(&w->wr_parked, memory_order_relaxed))
+		__pfifo_wake_writer(w);
+}
+
+/**
+ * pfifo_wait_readable - sleep until the fifo holds data
+ * @fifo: address of the fifo to be used
+ * @w: the waiter of the fifo
+ * @timeout_ms: maximum time to sleep, negative waits forever
+ *
+ * Must be called by the reader. Returns 0 when data is available or
+ * PFIFO_ETIMEDOUT.
+ */
+#define pfifo_wait_readable(fifo, w, timeout_ms) \
+__pfifo_int_must_check_helper( \
+({ \
+	typeof((fifo) + 1) __tmp = (fifo); \
+	__pfifo_wait_readable(&__tmp->pfifo, (w), (timeout_ms)); \
+}) \
+)
+
+/**
+ * pfifo_wait_writable - sleep until the fifo has room
+ * @fifo: address of the fifo to be used
+ * @w: the waiter of the fifo
+ * @n: number of elements (bytes of one record for record fifos) needed
+ * @timeout_ms: maximum time to sleep, negative waits forever
+ *
+ * Must be called by the writer. Returns 0 when @n elements fit,
+ * PFIFO_EINVAL when they never can or PFIFO_ETIMEDOUT.
+ */
+#define pfifo_wait_writable(fifo, w, n, timeout_ms) \
+__pfifo_int_must_check_helper( \
+({ \
+	typeof((fifo) + 1) __tmp = (fifo); \
+	const size_t __recsize = sizeof(*__tmp->rectype); \
+	__pfifo_wait_writable(&__tmp->pfifo, (w), (n), __recsize, (timeout_ms)); \
+}) \
+)
+
+/**
+ * pfifo_wait_poll_begin - prepare the reader to poll the eventfd
+ * @fifo: address of the fifo to be used
+ * @w: the waiter of the fifo, created with an eventfd
+ *
+ * Returns 1 when data is already available and poll() must be skipped,
+ * otherwise 0 and the eventfd will be signalled by the next put.
+ * Every call has to be paired with pfifo_wait_poll_end().
+ */
+#define pfifo_wait_poll_begin(fifo, w) \
+__pfifo_int_must_check_helper( \
+({ \
+	typeof((fifo) + 1) __tmp = (fifo); \
+	__pfifo_wait_poll_begin(&__tmp->pfifo, (w)); \
+}) \
+)
+
+extern int pfifo_wait_init(struct pfifo_wait *w, int use_eventfd);
+extern void pfifo_wait_destroy(struct pfifo_wait *w);
+extern void pfifo_wait_poll_end(struct pfifo_wait *w);
+extern int __pfifo_wait_readable(struct __pfifo *fifo, struct pfifo_wait *w, int timeout_ms);
+extern int __pfifo_wait_writable(struct __pfifo *fifo, struct pfifo_wait *w, unsigned int len,
+								size_t recsize, int timeout_ms);
+extern int __pfifo_wait_poll_begin(struct __pfifo *fifo, struct pfifo_wait *w);
+
+#endif
+
+/* ######################################################################## */
+/* ############################ MPMC pfifo ################################ */
+
+/*
+ * Multi-producer / multi-consumer bounded queue of fixed size elements.
+ * Every slot carries a sequence number telling whose turn it is, so any
+ * number of threads may put and get concurrently without locking.
+ * The sequence numbers are stored relative to the slot lap, which makes an
+ * all-zero fifo a valid empty one.
+ * The fields fixed at init come first and get a cache line of their own,
+ * so reading them never pulls in a line the producers or consumers are
+ * bouncing around. Fifos allocated with malloc only get malloc's alignment.
+ */
+struct __pfifo_mpmc {
+	unsigned int			mask;
+	unsigned int			esize;
+	atomic_uint				*seq;
+	void					*data;
+	unsigned char			__pad_ro[PFIFO_CACHE_LINE - 2 * sizeof(unsigned int) - 2 * sizeof(void *)];
+	atomic_uint				in;
+	unsigned char			__pad_in[PFIFO_CACHE_LINE - sizeof(atomic_uint)];
+	atomic_uint				out;
+	unsigned char			__pad_out[PFIFO_CACHE_LINE - sizeof(atomic_uint)];
+} __attribute__((aligned(PFIFO_CACHE_LINE)));
+
+#define __STRUCT_PFIFO_MPMC_COMMON(datatype, ptrtype) \
+	union { \
+		struct __pfifo_mpmc		pfifo; \
+		datatype				*type; \
+		const datatype			*const_type; \
+		ptrtype					*ptr; \
+		ptrtype const			*ptr_const; \
+	}
+
+#define __STRUCT_PFIFO_MPMC(type, size, ptrtype) \
+{ \
+	__STRUCT_PFIFO_MPMC_COMMON(type, ptrtype); \
+	atomic_uint	seqbuf[((size < 2) || (size & (size - 1))) ? -1 : size]; \
+	type		buf[size]; \
+}
+
+#define STRUCT_PFIFO_MPMC(type, size) \
+	struct __STRUCT_PFIFO_MPMC(type, size, type)
+
+#define __STRUCT_PFIFO_MPMC_PTR(type, ptrtype) \
+{ \
+	__STRUCT_PFIFO_MPMC_COMMON(type, ptrtype); \
+	atomic_uint	seqbuf[0]; \
+	type		buf[0]; \
+}
+
+#define STRUCT_PFIFO_MPMC_PTR(type) \
+	struct __STRUCT_PFIFO_MPMC_PTR(type, type)
+
+/*
+ * define compatibility "struct pfifo_mpmc" for dynamic allocated fifos
+ */
+struct pfifo_mpmc __STRUCT_PFIFO_MPMC_PTR(unsigned char, void);
+
+#define	__is_pfifo_mpmc_ptr(fifo) \
+	(sizeof(*fifo) == sizeof(STRUCT_PFIFO_MPMC_PTR(typeof(*(fifo)->type))))
+
+/**
+ * DECLARE_PFIFO_MPMC_PTR - macro to declare a mpmc fifo pointer object
+ * @fifo: name of the declared fifo
+ * @type: type of the fifo elements
+ */
+#define DECLARE_PFIFO_MPMC_PTR(fifo, type)	STRUCT_PFIFO_MPMC_PTR(type) fifo
+
+/**
+ * DECLARE_PFIFO_MPMC - macro to declare a mpmc fifo object
+ * @fifo: name of the declared fifo
+ * @type: type of the fifo elements
+ * @size: the number of elements in the fifo, this must be a power of 2
+ */
+#define DECLARE_PFIFO_MPMC(fifo, type, size)	STRUCT_PFIFO_MPMC(type, size) fifo
+
+/**
+ * INIT_PFIFO_MPMC - Initialize a fifo declared by DECLARE_PFIFO_MPMC
+ * @fifo: name of the declared fifo datatype
+ *
+ * Must not race with any put or get.
+ */
+#define INIT_PFIFO_MPMC(fifo) \
+(void)({ \
+	typeof(&(fifo)) __tmp = &(fifo); \
+	__pfifo_mpmc_init(&__tmp->pfifo, \
+		__is_pfifo_mpmc_ptr(__tmp) ? NULL : __tmp->buf, \
+		__is_pfifo_mpmc_ptr(__tmp) ? NULL : __tmp->seqbuf, \
+		PFIFO_ARRAY_SIZE(__tmp->buf), sizeof(*__tmp->buf)); \
+})
+
+/**
+ * DEFINE_PFIFO_MPMC - macro to define and initialize a mpmc fifo
+ * @fifo: name of the declared fifo datatype
+ * @type: type of the fifo elements
+ * @size: the number of elements in the fifo, this must be a power of 2
+ *
+ * Note: the macro can be used for global and local fifo data type variables.
+ */
+#define DEFINE_PFIFO_MPMC(fifo, type, size) \
+	DECLARE_PFIFO_MPMC(fifo, type, size) = \
+	(typeof(fifo)) { \
+		.pfifo = { \
+			.mask	= PFIFO_ARRAY_SIZE((fifo).buf) - 1, \
+			.esize	= sizeof(*(fifo).buf), \
+			.seq	= (fifo).seqbuf, \
+			.data	= (fifo).buf, \
+		}, \
+	}
+
+/**
+ * pfifo_mpmc_size - returns the size of the fifo in elements
+ * @fifo: address of the fifo to be used
+ */
+#define pfifo_mpmc_size(fifo)	((fifo)->pfifo.mask + 1)
+
+/**
+ * pfifo_mpmc_esize - returns the size of the element managed by the fifo
+ * @fifo: address of the fifo to be used
+ */
+#define pfifo_mpmc_esize(fifo)	((fifo)->pfifo.esize)
+
+/**
+ * pfifo_mpmc_len - returns the number of used elements in the fifo
+ * @fifo: address of the fifo to be used
+ *
+ * The result is only a snapshot while other threads are working on the fifo.
+ */
+#define pfifo_mpmc_len(fifo) \
+({ \
+	typeof((fifo) + 1) __tmpl = (fifo); \
+	unsigned int __out = atomic_load_explicit(&__tmpl->pfifo.out, memory_order_relaxed); \
+	unsigned int __in = atomic_load_explicit(&__tmpl->pfifo.in, memory_order_relaxed); \
+	(int)(__in - __out) > 0 ? __in - __out : 0; \
+})
+
+/**
+ * pfifo_mpmc_is_empty - returns true if the fifo is empty
+ * @fifo: address of the fifo to be used
+ */
+#define	pfifo_mpmc_is_empty(fifo)	(pfifo_mpmc_len(fifo) == 0)
+
+/**
+ * pfifo_mpmc_alloc - dynamically allocates a new mpmc fifo buffer
+ * @fifo: pointer to the fifo
+ * @size: the number of elements in the fifo, this must be a power of 2
+ *
+ * The number of elements will be rounded-up to a power of 2.
+ * The fifo will be release with pfifo_mpmc_free().
+ * Return 0 if no error, otherwise an error code.
+ */
+#define pfifo_mpmc_alloc(fifo, size) \
+__pfifo_int_must_check_helper( \
+({ \
+	typeof((fifo) + 1) __tmp = (fifo); \
+	__is_pfifo_mpmc_ptr(__tmp) ? \
+	__pfifo_mpmc_alloc(&__tmp->pfifo, size, sizeof(*__tmp->type)) : \
+	PFIFO_EINVAL; \
+}) \
+)
+
+/**
+ * pfifo_mpmc_free - frees the mpmc fifo
+ * @fifo: the fifo to be freed
+ */
+#define pfifo_mpmc_free(fifo) \
+({ \
+	typeof((fifo) + 1) __tmp = (fifo); \
+	if (__is_pfifo_mpmc_ptr(__tmp)) \
+		__pfifo_mpmc_free(&__tmp->pfifo); \
+})
+
+/**
+ * pfifo_mpmc_put - put data into the fifo
+ * @fifo: address of the fifo to be used
+ * @val: the data to be added
+ *
+ * It returns 0 if the fifo was full. Otherwise it returns 1.
+ * Safe to be called from any number of threads concurrently.
+ */
+#define	pfifo_mpmc_put(fifo, val) \
+({ \
+	typeof((fifo) + 1) __tmp = (fifo); \
+	typeof(*__tmp->const_type) __val = (val); \
+	__pfifo_mpmc_in(&__tmp->pfifo, &__val, 1); \
+})
+
+/**
+ * pfifo_mpmc_get - get data from the fifo
+ * @fifo: address of the fifo to be used
+ * @val: address where to store the data
+ *
+ * It returns 0 if the fifo was empty. Otherwise it returns 1.
+ * Safe to be called from any number of threads concurrently.
+ */
+#define	pfifo_mpmc_get(fifo, val) \
+__pfifo_uint_must_check_helper( \
+({ \
+	typeof((fifo) + 1) __tmp = (fifo); \
+	typeof(__tmp->ptr) __val = (val); \
+	__pfifo_mpmc_out(&__tmp->pfifo, __val, 1); \
+}) \
+)
+
+/**
+ * pfifo_mpmc_in - put data into the fifo
+ * @fifo: address of the fifo to be used
+ * @buf: the data to be added
+ * @n: number of elements to be added
+ *
+ * Every element is claimed on its own, so elements of concurrent callers
+ * may interleave. Returns the number of copied elements, stopping early
+ * when the fifo is full.
+ */
+#define	pfifo_mpmc_in(fifo, buf, n) \
+({ \
+	typeof((fifo) + 1) __tmp = (fifo); \
+	typeof(__tmp->ptr_const) __buf = (buf); \
+	unsigned long __n = (n); \
+	__pfifo_mpmc_in(&__tmp->pfifo, __buf, __n); \
+})
+
+/**
+ * pfifo_mpmc_out - get data from the fifo
+ * @fifo: address of the fifo to be used
+ * @buf: pointer to the storage buffer
+ * @n: max. number of elements to get
+ *
+ * Returns the number of copied elements, stopping early when the fifo
+ * is empty.
+ */
+#define	pfifo_mpmc_out(fifo, buf, n) \
+__pfifo_uint_must_check_helper( \
+({ \
+	typeof((fifo) + 1) __tmp = (fifo); \
+	typeof(__tmp->ptr) __buf = (buf); \
+	unsigned long __n = (n); \
+	__pfifo_mpmc_out(&__tmp->pfifo, __buf, __n); \
+}) \
+)
+
+extern int __pfifo_mpmc_alloc(struct __pfifo_mpmc *fifo, unsigned int size, size_t esize);
+extern void __pfifo_mpmc_free(struct __pfifo_mpmc *fifo);
+extern int __pfifo_mpmc_init(struct __pfifo_mpmc *fifo, void *buffer, atomic_uint *seq,
+							unsigned int size, size_t esize);
+extern unsigned int __pfifo_mpmc_in(struct __pfifo_mpmc *fifo, const void *buf, unsigned int len);
+extern unsigned int __pfifo_mpmc_out(struct __pfifo_mpmc *fifo, void *buf, unsigned int len);
+
 
 #endif
 
@@ -21,6 +21,20 @@
 
 #include "pfifo.h"
 
+#if PFIFO_USE_PLATFORM_LINUX
+#include <sys/uio.h>
+#endif
+
+#if PFIFO_USE_WAIT
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
 /************************************************************************************************************/
 /************************************************************************************************************/
 
@@ -49,14 +63,6 @@ static unsigned int roundup_pow_of_two(unsigned int x)
 /************************************************************************************************************/
 /************************************************************************************************************/
 
-/*
- * internal helper to calculate the unused elements in a fifo
- */
-static inline unsigned int pfifo_unused(struct __pfifo *fifo)
-{
-	return (fifo->mask + 1) - (fifo->in - fifo->out);
-}
-
 /* int __pfifo_alloc(struct __pfifo *fifo, unsigned int size, size_t esize, gfp_t gfp_mask) */
 int __pfifo_alloc(struct __pfifo *fifo, unsigned int size, size_t esize)
 {
@@ -66,8 +72,7 @@ int __pfifo_alloc(struct __pfifo *fifo, unsigned int size, size_t esize)
 	 */
 	size = roundup_pow_of_two(size);
 
-	fifo->in = 0;
-	fifo->out = 0;
+	__pfifo_reset_cache(fifo, 0);
 	fifo->esize = esize;
 
 	if (size < 2)
@@ -93,8 +98,7 @@ void __pfifo_free(struct __pfifo *fifo)
 {
 	/* kfree(fifo->data); */
 	__pfifo_mem_free(fifo->data);
-	fifo->in = 0;
-	fifo->out = 0;
+	__pfifo_reset_cache(fifo, 0);
 	fifo->esize = 0;
 	fifo->data = NULL;
 	fifo->mask = 0;
@@ -107,8 +111,7 @@ int __pfifo_init(struct __pfifo *fifo, void *buffer,
 
 	size = roundup_pow_of_two(size);
 
-	fifo->in = 0;
-	fifo->out = 0;
+	__pfifo_reset_cache(fifo, 0);
 	fifo->esize = esize;
 	fifo->data = buffer;
 
@@ -151,7 +154,7 @@ unsigned int __pfifo_in(struct __pfifo *fifo, const void *buf, unsigned int len)
 {
 	unsigned int l;
 
-	l = pfifo_unused(fifo);
+	l = __pfifo_prod_avail(fifo, len);
 	if (len > l)
 		len = l;
 
@@ -188,7 +191,7 @@ unsigned int __pfifo_out_peek(struct __pfifo *fifo, void *buf, unsigned int len)
 {
 	unsigned int l;
 
-	l = fifo->in - fifo->out;
+	l = __pfifo_cons_avail(fifo, len);
 	if (len > l)
 		len = l;
 
@@ -206,7 +209,8 @@ unsigned int __pfifo_out(struct __pfifo *fifo,
 
 unsigned int __pfifo_max_r(unsigned int len, size_t recsize)
 {
-	unsigned int max = (1 << (recsize << 3)) - 1;
+	unsigned int max = recsize >= sizeof(unsigned int) ?
+		~0U : (1U << (recsize << 3)) - 1;
 
 	if (len > max)
 		return max;
@@ -216,41 +220,61 @@ unsigned int __pfifo_max_r(unsigned int len, size_t recsize)
 #define	__PFIFO_PEEK(data, out, mask) \
 	((data)[(out) & (mask)])
 /*
- * __pfifo_peek_n internal helper function for determinate the length of
- * the next record in the fifo
+ * __pfifo_peek_n_at internal helper function for determinate the length of
+ * the record at @off, the header is stored little endian
  */
-static unsigned int __pfifo_peek_n(struct __pfifo *fifo, size_t recsize)
+static unsigned int __pfifo_peek_n_at(struct __pfifo *fifo, unsigned int off, size_t recsize)
 {
 	unsigned int l;
 	unsigned int mask = fifo->mask;
 	unsigned char *data = fifo->data;
+	size_t i;
 
-	l = __PFIFO_PEEK(data, fifo->out, mask);
+	l = __PFIFO_PEEK(data, off, mask);
 
-	if (--recsize)
-		l |= __PFIFO_PEEK(data, fifo->out + 1, mask) << 8;
+	for (i = 1; i < recsize; i++)
+		l |= (unsigned int)__PFIFO_PEEK(data, off + i, mask) << (i << 3);
 
 	return l;
 }
 
+/*
+ * __pfifo_peek_n internal helper function for determinate the length of
+ * the next record in the fifo
+ */
+static unsigned int __pfifo_peek_n(struct __pfifo *fifo, size_t recsize)
+{
+	return __pfifo_peek_n_at(fifo, fifo->out, recsize);
+}
+
 #define	__PFIFO_POKE(data, in, mask, val) \
 	( \
 	(data)[(in) & (mask)] = (unsigned char)(val) \
 	)
 
 /*
- * __pfifo_poke_n internal helper function for storeing the length of
- * the record into the fifo
+ * __pfifo_poke_n_at internal helper function for storeing the length of
+ * the record at @off
  */
-static void __pfifo_poke_n(struct __pfifo *fifo, unsigned int n, size_t recsize)
+static void __pfifo_poke_n_at(struct __pfifo *fifo, unsigned int off, unsigned int n, size_t recsize)
 {
 	unsigned int mask = fifo->mask;
 	unsigned char *data = fifo->data;
+	size_t i;
 
-	__PFIFO_POKE(data, fifo->in, mask, n);
+	__PFIFO_POKE(data, off, mask, n);
 
-	if (recsize > 1)
-		__PFIFO_POKE(data, fifo->in + 1, mask, n >> 8);
+	for (i = 1; i < recsize; i++)
+		__PFIFO_POKE(data, off + i, mask, n >> (i << 3));
+}
+
+/*
+ * __pfifo_poke_n internal helper function for storeing the length of
+ * the record into the fifo
+ */
+static void __pfifo_poke_n(struct __pfifo *fifo, unsigned int n, size_t recsize)
+{
+	__pfifo_poke_n_at(fifo, fifo->in, n, recsize);
 }
 
 unsigned int __pfifo_len_r(struct __pfifo *fifo, size_t recsize)
@@ -260,7 +284,7 @@ unsigned int __pfifo_len_r(struct __pfifo *fifo, size_t recsize)
 
 unsigned int __pfifo_in_r(struct __pfifo *fifo, const void *buf, unsigned int len, size_t recsize)
 {
-	if (len + recsize > pfifo_unused(fifo))
+	if (len + recsize > __pfifo_prod_avail(fifo, len + recsize))
 		return 0;
 
 	__pfifo_poke_n(fifo, len, recsize);
@@ -285,7 +309,7 @@ unsigned int __pfifo_out_peek_r(struct __pfifo *fifo, void *buf, unsigned int le
 {
 	unsigned int n;
 
-	if (fifo->in == fifo->out)
+	if (!__pfifo_cons_avail(fifo, 1))
 		return 0;
 
 	return pfifo_out_copy_r(fifo, buf, len, recsize, &n);
@@ -295,7 +319,7 @@ unsigned int __pfifo_out_r(struct __pfifo *fifo, void *buf, unsigned int len, si
 {
 	unsigned int n;
 
-	if (fifo->in == fifo->out)
+	if (!__pfifo_cons_avail(fifo, 1))
 		return 0;
 
 	len = pfifo_out_copy_r(fifo, buf, len, recsize, &n);
@@ -311,19 +335,534 @@ void __pfifo_skip_r(struct __pfifo *fifo, size_t recsize)
 	fifo->out += n + recsize;
 }
 
+/*
+ * describe @len elements starting at @off as at most two contiguous pieces
+ */
+static void pfifo_span_fill(struct __pfifo *fifo, struct pfifo_span *span,
+                            unsigned int len, unsigned int off)
+{
+	unsigned int size = fifo->mask + 1;
+	unsigned int l;
+
+	off &= fifo->mask;
+	l = min(len, size - off);
+
+	span->buf[0] = (unsigned char *)fifo->data + off * fifo->esize;
+	span->len[0] = l;
+	span->buf[1] = len > l ? fifo->data : NULL;
+	span->len[1] = len - l;
+}
+
+unsigned int __pfifo_in_reserve(struct __pfifo *fifo, struct pfifo_span *span, unsigned int len)
+{
+	unsigned int l;
+
+	l = __pfifo_prod_avail(fifo, len);
+	if (len > l)
+		len = l;
+
+	pfifo_span_fill(fifo, span, len, fifo->in);
+	return len;
+}
+
+void __pfifo_in_commit(struct __pfifo *fifo, unsigned int len)
+{
+	/*
+	 * make sure that the data written in place is visible before
+	 * incrementing the fifo->in index counter
+	 */
+	__pfifo_smp_wmb();
+	fifo->in += len;
+}
+
+unsigned int __pfifo_out_reserve(struct __pfifo *fifo, struct pfifo_span *span, unsigned int len)
+{
+	unsigned int l;
+
+	l = __pfifo_cons_avail(fifo, len);
+	if (len > l)
+		len = l;
+
+	pfifo_span_fill(fifo, span, len, fifo->out);
+	return len;
+}
+
+void __pfifo_out_commit(struct __pfifo *fifo, unsigned int len)
+{
+	/*
+	 * make sure that the data is no longer read before
+	 * incrementing the fifo->out index counter
+	 */
+	__pfifo_smp_wmb();
+	fifo->out += len;
+}
+
+unsigned int __pfifo_in_reserve_r(struct __pfifo *fifo, struct pfifo_span *span, unsigned int len, size_t recsize)
+{
+	if (len != __pfifo_max_r(len, recsize) ||
+		len + recsize > __pfifo_prod_avail(fifo, len + recsize))
+		return 0;
+
+	pfifo_span_fill(fifo, span, len, fifo->in + recsize);
+	return len;
+}
+
+void __pfifo_in_commit_r(struct __pfifo *fifo, unsigned int len, size_t recsize)
+{
+	__pfifo_poke_n(fifo, len, recsize);
+	__pfifo_smp_wmb();
+	fifo->in += len + recsize;
+}
+
+unsigned int __pfifo_out_reserve_r(struct __pfifo *fifo, struct pfifo_span *span, size_t recsize)
+{
+	unsigned int n;
+
+	if (!__pfifo_cons_avail(fifo, 1))
+		return 0;
+
+	n = __pfifo_peek_n(fifo, recsize);
+	pfifo_span_fill(fifo, span, n, fifo->out + recsize);
+	return n;
+}
+
+void __pfifo_out_commit_r(struct __pfifo *fifo, size_t recsize)
+{
+	unsigned int n;
+
+	n = __pfifo_peek_n(fifo, recsize);
+	__pfifo_smp_wmb();
+	fifo->out += n + recsize;
+}
+
+#if PFIFO_USE_PLATFORM_LINUX
+static int pfifo_span_iov(const struct pfifo_span *span, struct iovec *iov)
+{
+	iov[0].iov_base = span->buf[0];
+	iov[0].iov_len = span->len[0];
+	iov[1].iov_base = span->buf[1];
+	iov[1].iov_len = span->len[1];
+	return span->len[1] ? 2 : 1;
+}
 
+int __pfifo_in_fd(struct __pfifo *fifo, int fd, unsigned int len)
+{
+	struct pfifo_span span;
+	struct iovec iov[2];
+	ssize_t ret;
 
+	if (fifo->esize != 1)
+		return PFIFO_EINVAL;
+	if (!__pfifo_in_reserve(fifo, &span, len))
+		return 0;
 
+	ret = readv(fd, iov, pfifo_span_iov(&span, iov));
+	if (ret <= 0)
+		return ret < 0 ? PFIFO_ESYS : 0;
 
+	__pfifo_in_commit(fifo, ret);
+	return ret;
+}
 
+int __pfifo_out_fd(struct __pfifo *fifo, int fd, unsigned int len)
+{
+	struct pfifo_span span;
+	struct iovec iov[2];
+	ssize_t ret;
 
+	if (fifo->esize != 1)
+		return PFIFO_EINVAL;
+	if (!__pfifo_out_reserve(fifo, &span, len))
+		return 0;
 
+	ret = writev(fd, iov, pfifo_span_iov(&span, iov));
+	if (ret <= 0)
+		return ret < 0 ? PFIFO_ESYS : 0;
 
+	__pfifo_out_commit(fifo, ret);
+	return ret;
+}
+#endif
 
+/*
+ * Bulk record operations walk the headers with a local index and publish
+ * the index once, so a batch costs one load of the other side's index and
+ * one store of our own instead of one of each per record.
+ */
+unsigned int __pfifo_in_bulk_r(struct __pfifo *fifo, const struct pfifo_iov *iov,
+                               unsigned int n, size_t recsize)
+{
+	unsigned int in = fifo->in;
+	unsigned int need = 0;
+	unsigned int avail, len, i;
 
+	for (i = 0; i < n; i++)
+		need += iov[i].len + recsize;
+	avail = __pfifo_prod_avail(fifo, need);
 
+	for (i = 0; i < n; i++)
+		{
+			len = iov[i].len;
+			if (len != __pfifo_max_r(len, recsize) || len + recsize > avail)
+				break;
+			__pfifo_poke_n_at(fifo, in, len, recsize);
+			pfifo_copy_in(fifo, iov[i].buf, len, in + recsize);
+			in += len + recsize;
+			avail -= len + recsize;
+		}
 
+	fifo->in = in;
+	return i;
+}
 
+/*
+ * walk up to @n whole records from fifo->out, stopping before the record
+ * that would take the payload over @max_bytes (0 for no limit); the first
+ * record is always taken so that a large one cannot stall the fifo
+ */
+static unsigned int pfifo_walk_r(struct __pfifo *fifo, struct pfifo_iov *iov, struct pfifo_span *span,
+                                 unsigned int n, unsigned int max_bytes, size_t recsize)
+{
+	unsigned int used = __pfifo_cons_avail(fifo, fifo->mask + 1);
+	unsigned int out = fifo->out;
+	unsigned int bytes = 0;
+	unsigned int l, i;
 
+	/* records are published whole, anything used starts with a full record */
+	for (i = 0; i < n && used; i++)
+		{
+			l = __pfifo_peek_n_at(fifo, out, recsize);
+			if (i && max_bytes && (bytes >= max_bytes || l > max_bytes - bytes))
+				break;
+			if (iov)
+				{
+					iov[i].len = min(l, iov[i].len);
+					pfifo_copy_out(fifo, iov[i].buf, iov[i].len, out + recsize);
+				}
+			else
+				pfifo_span_fill(fifo, &span[i], l, out + recsize);
+			bytes += l;
+			out += l + recsize;
+			used -= l + recsize;
+		}
 
+	if (iov)
+		fifo->out = out;
+	return i;
+}
+
+unsigned int __pfifo_out_bulk_r(struct __pfifo *fifo, struct pfifo_iov *iov, unsigned int n,
+                                unsigned int max_bytes, size_t recsize)
+{
+	return pfifo_walk_r(fifo, iov, NULL, n, max_bytes, recsize);
+}
 
+unsigned int __pfifo_out_reserve_bulk_r(struct __pfifo *fifo, struct pfifo_span *span, unsigned int n,
+                                        unsigned int max_bytes, size_t recsize)
+{
+	return pfifo_walk_r(fifo, NULL, span, n, max_bytes, recsize);
+}
+
+void __pfifo_out_commit_bulk_r(struct __pfifo *fifo, const struct pfifo_span *span, unsigned int n,
+                               size_t recsize)
+{
+	unsigned int len = 0;
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		len += span[i].len[0] + span[i].len[1] + recsize;
+
+	__pfifo_smp_wmb();
+	fifo->out += len;
+}
+
+#if PFIFO_USE_WAIT
+/************************************************************************************************************/
+/************************************************************************************************************/
+
+/*
+ * The sleeper bumps its parked counter, re-checks the fifo and sleeps on
+ * the sequence word; the other side publishes its index, then checks the
+ * parked counter. Both sides put a full fence between their store and
+ * their load, so at least one of them sees the other and no wakeup is lost.
+ */
+static int pfifo_futex_wait(atomic_uint *addr, unsigned int val, const struct timespec *deadline)
+{
+	/* FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC deadline */
+	if (syscall(SYS_futex, addr, FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG, val,
+		deadline, NULL, FUTEX_BITSET_MATCH_ANY) < 0 && errno == ETIMEDOUT)
+		return PFIFO_ETIMEDOUT;
+	return 0;
+}
+
+static void pfifo_futex_wake(atomic_uint *addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, INT_MAX, NULL, NULL, 0);
+}
+
+static void pfifo_deadline(struct timespec *ts, int timeout_ms)
+{
+	clock_gettime(CLOCK_MONOTONIC, ts);
+	ts->tv_sec += timeout_ms / 1000;
+	ts->tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+	if (ts->tv_nsec >= 1000000000)
+		{
+			ts->tv_sec++;
+			ts->tv_nsec -= 1000000000;
+		}
+}
+
+int pfifo_wait_init(struct pfifo_wait *w, int use_eventfd)
+{
+	atomic_init(&w->rd_seq, 0);
+	atomic_init(&w->rd_parked, 0);
+	atomic_init(&w->rd_polled, 0);
+	atomic_init(&w->wr_seq, 0);
+	atomic_init(&w->wr_parked, 0);
+	w->efd = -1;
+
+	if (use_eventfd)
+		{
+			w->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			if (w->efd < 0)
+				return PFIFO_ESYS;
+		}
+	return 0;
+}
+
+void pfifo_wait_destroy(struct pfifo_wait *w)
+{
+	if (w->efd >= 0)
+		close(w->efd);
+	w->efd = -1;
+}
+
+void __pfifo_wake_reader(struct pfifo_wait *w)
+{
+	if (atomic_load_explicit(&w->rd_parked, memory_order_relaxed))
+		{
+			atomic_fetch_add_explicit(&w->rd_seq, 1, memory_order_release);
+			pfifo_futex_wake(&w->rd_seq);
+		}
+	if (w->efd >= 0 && atomic_load_explicit(&w->rd_polled, memory_order_relaxed))
+		eventfd_write(w->efd, 1);
+}
+
+void __pfifo_wake_writer(struct pfifo_wait *w)
+{
+	atomic_fetch_add_explicit(&w->wr_seq, 1, memory_order_release);
+	pfifo_futex_wake(&w->wr_seq);
+}
+
+int __pfifo_wait_readable(struct __pfifo *fifo, struct pfifo_wait *w, int timeout_ms)
+{
+	struct timespec deadline;
+	unsigned int seq;
+	int ret = 0;
+
+	if (__pfifo_cons_avail(fifo, 1))
+		return 0;
+	if (timeout_ms == 0)
+		return PFIFO_ETIMEDOUT;
+	if (timeout_ms > 0)
+		pfifo_deadline(&deadline, timeout_ms);
+
+	atomic_fetch_add_explicit(&w->rd_parked, 1, memory_order_relaxed);
+	for (;;)
+		{
+			seq = atomic_load_explicit(&w->rd_seq, memory_order_acquire);
+			atomic_thread_fence(memory_order_seq_cst);
+			if (__pfifo_cons_avail(fifo, 1))
+				break;
+			ret = pfifo_futex_wait(&w->rd_seq, seq, timeout_ms > 0 ? &deadline : NULL);
+			if (ret)
+				break;
+		}
+	atomic_fetch_sub_explicit(&w->rd_parked, 1, memory_order_relaxed);
+
+	/* the data may have landed just before the deadline */
+	if (ret && __pfifo_cons_avail(fifo, 1))
+		ret = 0;
+	return ret;
+}
+
+int __pfifo_wait_writable(struct __pfifo *fifo, struct pfifo_wait *w, unsigned int len,
+                          size_t recsize, int timeout_ms)
+{
+	struct timespec deadline;
+	unsigned int seq;
+	int ret = 0;
+
+	if (recsize && len != __pfifo_max_r(len, recsize))
+		return PFIFO_EINVAL;
+	len += recsize;
+	if (len > fifo->mask + 1)
+		return PFIFO_EINVAL;
+
+	if (__pfifo_prod_avail(fifo, len) >= len)
+		return 0;
+	if (timeout_ms == 0)
+		return PFIFO_ETIMEDOUT;
+	if (timeout_ms > 0)
+		pfifo_deadline(&deadline, timeout_ms);
+
+	atomic_fetch_add_explicit(&w->wr_parked, 1, memory_order_relaxed);
+	for (;;)
+		{
+			seq = atomic_load_explicit(&w->wr_seq, memory_order_acquire);
+			atomic_thread_fence(memory_order_seq_cst);
+			if (__pfifo_prod_avail(fifo, len) >= len)
+				break;
+			ret = pfifo_futex_wait(&w->wr_seq, seq, timeout_ms > 0 ? &deadline : NULL);
+			if (ret)
+				break;
+		}
+	atomic_fetch_sub_explicit(&w->wr_parked, 1, memory_order_relaxed);
+
+	if (ret && __pfifo_prod_avail(fifo, len) >= len)
+		ret = 0;
+	return ret;
+}
+
+int __pfifo_wait_poll_begin(struct __pfifo *fifo, struct pfifo_wait *w)
+{
+	atomic_fetch_add_explicit(&w->rd_polled, 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	return __pfifo_cons_avail(fifo, 1) != 0;
+}
+
+void pfifo_wait_poll_end(struct pfifo_wait *w)
+{
+	eventfd_t v;
+
+	atomic_fetch_sub_explicit(&w->rd_polled, 1, memory_order_relaxed);
+	/* drop wakeups already consumed, the fifo itself is the level */
+	if (w->efd >= 0)
+		eventfd_read(w->efd, &v);
+}
+#endif
+
+/************************************************************************************************************/
+/************************************************************************************************************/
+
+/*
+ * MPMC fifo. Slot i serves positions p with (p & mask) == i; with
+ * lap = p & ~mask its sequence number reads:
+ *   lap       free, a producer at p may claim it
+ *   lap + 1   filled, a consumer at p may claim it
+ * and a consumer hands it on to the next lap by storing lap + size.
+ */
+int __pfifo_mpmc_init(struct __pfifo_mpmc *fifo, void *buffer, atomic_uint *seq,
+                      unsigned int size, size_t esize)
+{
+	unsigned int i;
+
+	atomic_init(&fifo->in, 0);
+	atomic_init(&fifo->out, 0);
+	fifo->esize = esize;
+	fifo->data = buffer;
+	fifo->seq = seq;
+
+	if (size < 2 || (size & (size - 1)) || !buffer || !seq)
+		{
+			fifo->mask = 0;
+			return -1;
+		}
+	for (i = 0; i < size; i++)
+		atomic_init(&seq[i], 0);
+	fifo->mask = size - 1;
+
+	return 0;
+}
+
+int __pfifo_mpmc_alloc(struct __pfifo_mpmc *fifo, unsigned int size, size_t esize)
+{
+	void *data;
+
+	size = roundup_pow_of_two(size);
+	if (size < 2)
+		{
+			__pfifo_mpmc_init(fifo, NULL, NULL, 0, esize);
+			return -1;
+		}
+
+	data = __pfifo_mem_malloc(size * (esize + sizeof(atomic_uint)));
+	if (!data)
+		{
+			__pfifo_mpmc_init(fifo, NULL, NULL, 0, esize);
+			return PFIFO_ENOMEM;
+		}
+
+	/* the sequence array goes first to keep it aligned */
+	return __pfifo_mpmc_init(fifo, (atomic_uint *)data + size, data, size, esize);
+}
+
+void __pfifo_mpmc_free(struct __pfifo_mpmc *fifo)
+{
+	__pfifo_mem_free(fifo->seq);
+	__pfifo_mpmc_init(fifo, NULL, NULL, 0, 0);
+}
+
+unsigned int __pfifo_mpmc_in(struct __pfifo_mpmc *fifo, const void *buf, unsigned int len)
+{
+	unsigned int mask = fifo->mask;
+	unsigned int pos, lap, seq, i;
+	int diff;
+
+	for (i = 0; i < len; i++)
+		{
+			pos = atomic_load_explicit(&fifo->in, memory_order_relaxed);
+			for (;;)
+				{
+					lap = pos & ~mask;
+					seq = atomic_load_explicit(&fifo->seq[pos & mask], memory_order_acquire);
+					diff = (int)(seq - lap);
+					if (diff == 0)
+						{
+							if (atomic_compare_exchange_weak_explicit(&fifo->in, &pos, pos + 1,
+								memory_order_relaxed, memory_order_relaxed))
+								break;
+						}
+					else if (diff < 0)
+						return i;	/* the slot still holds last lap's element: full */
+					else
+						pos = atomic_load_explicit(&fifo->in, memory_order_relaxed);
+				}
+			memcpy((unsigned char *)fifo->data + (pos & mask) * fifo->esize,
+			       (const unsigned char *)buf + i * fifo->esize, fifo->esize);
+			atomic_store_explicit(&fifo->seq[pos & mask], lap + 1, memory_order_release);
+		}
+	return len;
+}
+
+unsigned int __pfifo_mpmc_out(struct __pfifo_mpmc *fifo, void *buf, unsigned int len)
+{
+	unsigned int mask = fifo->mask;
+	unsigned int pos, lap, seq, i;
+	int diff;
+
+	for (i = 0; i < len; i++)
+		{
+			pos = atomic_load_explicit(&fifo->out, memory_order_relaxed);
+			for (;;)
+				{
+					lap = pos & ~mask;
+					seq = atomic_load_explicit(&fifo->seq[pos & mask], memory_order_acquire);
+					diff = (int)(seq - (lap + 1));
+					if (diff == 0)
+						{
+							if (atomic_compare_exchange_weak_explicit(&fifo->out, &pos, pos + 1,
+								memory_order_relaxed, memory_order_relaxed))
+								break;
+						}
+					else if (diff < 0)
+						return i;	/* not filled yet: empty */
+					else
+						pos = atomic_load_explicit(&fifo->out, memory_order_relaxed);
+				}
+			memcpy((unsigned char *)buf + i * fifo->esize,
+			       (unsigned char *)fifo->data + (pos & mask) * fifo->esize, fifo->esize);
+			atomic_store_explicit(&fifo->seq[pos & mask], lap + mask + 1, memory_order_release);
+		}
+	return len;
+}
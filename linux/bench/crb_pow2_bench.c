@@ -0,0 +1,87 @@
+/**
+ * @file crb_pow2_bench.c
+ * @brief Crb 取模模式与2的幂模式的读写耗时对比
+ * 		同样4096字节的缓冲区,分别由 crb_New 与 crb_NewPow2 创建,
+ * 		反复写入再读出一小块数据,写入长度与缓冲区大小互质,读写指针会走遍所有位置
+ *
+ * 编译(在仓库根目录):
+ * 	gcc -O2 -Igeneral/inc -Ilinux/inc linux/bench/crb_pow2_bench.c \
+ * 		general/common_ringbuffer.c -o crb_pow2_bench
+ * 运行:
+ * 	./crb_pow2_bench [读写次数=20000000] [每次字节数=13]
+ * @author simon.xiaoapeng (simon.xiaoapeng@gmail.com)
+ * @version 1.0
+ * @date 2023-08-28
+ *
+ * @copyright Copyright (c) 2023  simon.xiaoapeng@gmail.com
+ *
+ * @par 修改日志:
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "typedef.h"
+#include "common_ringbuffer.h"
+
+#define BENCH_CRB_SIZE		4096
+#define BENCH_CHUNK_MAX		256
+
+static uint64_t bench_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* 防止读出的数据被整体优化掉 */
+static volatile uint32_t bench_sink;
+
+static double bench_run(Crb *crb,uint32_t loops,uint32_t chunk)
+{
+	uint8_t		w[BENCH_CHUNK_MAX],r[BENCH_CHUNK_MAX];
+	uint64_t	start;
+	uint32_t	i,j,sum = 0;
+
+	for(j = 0; j < chunk; j++)
+		w[j] = (uint8_t)j;
+	start = bench_ns();
+	for(i = 0; i < loops; i++)
+	{
+		crb_Write(crb, w, chunk);
+		crb_Read(crb, r, chunk);
+		sum += r[i % chunk];
+	}
+	start = bench_ns() - start;
+	bench_sink = sum;
+	if(crb_Size(crb) != 0)
+		printf("unexpected data left in buffer\n");
+	return start / 1e9;
+}
+
+int main(int argc,char *argv[])
+{
+	uint32_t	loops = argc > 1 ? (uint32_t)atoi(argv[1]) : 20000000;
+	uint32_t	chunk = argc > 2 ? (uint32_t)atoi(argv[2]) : 13;
+	Crb			*mod,*pow2;
+	double		t_mod,t_pow2;
+
+	if(loops == 0 || chunk == 0 || chunk > BENCH_CHUNK_MAX){
+		printf("usage: %s [loops] [chunk<=%d]\n", argv[0], BENCH_CHUNK_MAX);
+		return 1;
+	}
+	mod = crb_New(BENCH_CRB_SIZE);
+	pow2 = crb_NewPow2(BENCH_CRB_SIZE);
+	if(!mod || !pow2) return 1;
+
+	t_mod = bench_run(mod, loops, chunk);
+	t_pow2 = bench_run(pow2, loops, chunk);
+	printf("%u x %u-byte write/read pairs\n", loops, chunk);
+	printf("%-8s %8.3fs\n", "modulo", t_mod);
+	printf("%-8s %8.3fs\n", "pow2", t_pow2);
+
+	crb_Del(mod);
+	crb_Del(pow2);
+	return 0;
+}
@@ -0,0 +1,128 @@
+/**
+ * @file hash_kv_image_bench.c
+ * @brief hash_kv 表镜像的保存/加载/映射耗时,并校验跨哈希算法加载的正确性
+ * 		用 HASH_POLICY_RS 建表并保存镜像,然后分别:
+ * 		加载到同算法的表		直接复用镜像中的哈希值
+ * 		加载到 HASH_POLICY_WY 的分片表	按键重新计算哈希值
+ * 		hash_MapImage 只读映射
+ * 		每种方式都逐个读回所有键核对,其中一半是含0的二进制键,任何不一致都以非0退出
+ *
+ * 编译(在仓库根目录):
+ * 	gcc -O2 -Igeneral/inc -Ilinux/inc linux/bench/hash_kv_image_bench.c \
+ * 		general/hash_kv.c general/crc_check.c general/pfifo.c -lpthread -o hash_kv_image_bench
+ * 运行:
+ * 	./hash_kv_image_bench [键数量=200000] [镜像路径=/tmp/hash_kv_image_bench.bin]
+ * @author simon.xiaoapeng (simon.xiaoapeng@gmail.com)
+ * @version 1.0
+ * @date 2023-04-01
+ *
+ * @copyright Copyright (c) 2023  simon.xiaoapeng@gmail.com
+ *
+ * @par 修改日志:
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include "typedef.h"
+#include "hash_kv.h"
+
+#define BENCH_KEY_LEN		12
+
+static uint64_t bench_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* 偶数号为字符串键,奇数号为中间含0的二进制键 */
+static uint32_t bench_key(uint32_t i,char *k)
+{
+	if(i & 1){
+		memcpy(k, "bin", 3);
+		k[3] = '\0';
+		memcpy(k + 4, &i, sizeof(i));
+		return 8;
+	}
+	return (uint32_t)snprintf(k, BENCH_KEY_LEN, "str/%u", i);
+}
+
+static int bench_verify(const char *name,HashKv_t ht,uint32_t n)
+{
+	char		k[BENCH_KEY_LEN];
+	uint32_t	i,v,k_len;
+	uint64_t	start = bench_ns();
+
+	for(i = 0; i < n; i++)
+	{
+		k_len = bench_key(i, k);
+		if(hash_GetDataBin(ht, k, k_len, &v, sizeof(v)) != sizeof(v) || v != i){
+			printf("%-16s key %u lost\n", name, i);
+			return -1;
+		}
+	}
+	printf("%-16s verify %8.1f ms\n", name, (bench_ns() - start) / 1e6);
+	return 0;
+}
+
+int main(int argc,char *argv[])
+{
+	uint32_t	n = argc > 1 ? (uint32_t)atoi(argv[1]) : 200000;
+	const char	*path = argc > 2 ? argv[2] : "/tmp/hash_kv_image_bench.bin";
+	char		k[BENCH_KEY_LEN];
+	HashKv_t	src,dst;
+	uint64_t	start;
+	uint32_t	i;
+	int			ret = 0;
+
+	src = hash_New(n);
+	hash_SetHashPolicy(src, HASH_POLICY_RS);
+	for(i = 0; i < n; i++)
+		hash_SetDataBin(src, k, bench_key(i, k), &i, sizeof(i));
+
+	start = bench_ns();
+	if(hash_SaveImage(src, path)){
+		printf("hash_SaveImage failed\n");
+		return 1;
+	}
+	printf("%-16s        %8.1f ms\n", "save", (bench_ns() - start) / 1e6);
+	hash_Del(src);
+
+	dst = hash_New(n);
+	hash_SetHashPolicy(dst, HASH_POLICY_RS);
+	start = bench_ns();
+	if(hash_LoadImage(dst, path) != (int)n){
+		printf("hash_LoadImage(same policy) failed\n");
+		return 1;
+	}
+	printf("%-16s load   %8.1f ms\n", "same policy", (bench_ns() - start) / 1e6);
+	ret |= bench_verify("same policy", dst, n);
+	hash_Del(dst);
+
+	dst = hash_NewSharded(n, HASH_ENGINE_OPEN, 4);
+	hash_SetHashPolicy(dst, HASH_POLICY_WY);
+	start = bench_ns();
+	if(hash_LoadImage(dst, path) != (int)n){
+		printf("hash_LoadImage(other policy) failed\n");
+		return 1;
+	}
+	printf("%-16s load   %8.1f ms\n", "other policy", (bench_ns() - start) / 1e6);
+	ret |= bench_verify("other policy", dst, n);
+	hash_Del(dst);
+
+	start = bench_ns();
+	dst = hash_MapImage(path);
+	if(!dst){
+		printf("hash_MapImage failed\n");
+		return 1;
+	}
+	printf("%-16s map    %8.1f ms\n", "mapped", (bench_ns() - start) / 1e6);
+	ret |= bench_verify("mapped", dst, n);
+	hash_Del(dst);
+
+	remove(path);
+	return ret ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file hash_kv_iter_test.c
+ * @brief 在 hash_Iteration 的处理函数中向开放寻址表大量插入,检查迭代结束后的rehash不会卡死
+ * 		迭代期间rehash暂停,新数据项都插入新表,若新表没有给旧表剩余的数据项留出空位,
+ * 		迭代结束后迁移旧表时会在 _OpenInsert 中找不到空槽而死循环
+ * 		处理函数中插入的键数量远超新表长度的一半,插入失败是允许的,
+ * 		但迭代结束后所有插入成功的键都必须能读回,且新的插入要能继续成功
+ * 		卡死时由 alarm 结束进程,任何失败都以非0退出
+ *
+ * 编译(在仓库根目录):
+ * 	gcc -O2 -Igeneral/inc -Ilinux/inc linux/bench/hash_kv_iter_test.c \
+ * 		general/hash_kv.c general/crc_check.c general/pfifo.c -lpthread -o hash_kv_iter_test
+ * 运行:
+ * 	./hash_kv_iter_test
+ * @author simon.xiaoapeng (simon.xiaoapeng@gmail.com)
+ * @version 1.0
+ * @date 2023-04-01
+ *
+ * @copyright Copyright (c) 2023  simon.xiaoapeng@gmail.com
+ *
+ * @par 修改日志:
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "typedef.h"
+#include "hash_kv.h"
+
+#define TEST_TAB_LEN		16
+#define TEST_BEFORE			12		/* 迭代前写入的键数量,刚好不触发扩容 */
+#define TEST_IN_ITER		1000	/* 处理函数中尝试插入的键数量 */
+#define TEST_AFTER			1000	/* 迭代结束后再写入的键数量 */
+
+struct test_ctx {
+	HashKv_t	ht;
+	int			done;
+	uint32_t	ok[TEST_IN_ITER];	/* 处理函数中插入成功的键 */
+	uint32_t	ok_num;
+};
+
+static enum HashIterState test_insert(void *param,HashBlob_t *b)
+{
+	struct test_ctx	*ctx = param;
+	uint32_t		i;
+
+	(void)b;
+	if(ctx->done)
+		return ITER_KEEP;
+	ctx->done = 1;
+	for(i = TEST_BEFORE; i < TEST_BEFORE + TEST_IN_ITER; i++)
+	{
+		if(hash_SetDataU32(ctx->ht, i, &i, sizeof(i)) > 0)
+			ctx->ok[ctx->ok_num++] = i;
+	}
+	return ITER_KEEP;
+}
+
+static int test_check(HashKv_t ht,uint32_t key)
+{
+	uint32_t	v;
+
+	if(hash_GetDataU32(ht, key, &v, sizeof(v)) != sizeof(v) || v != key){
+		printf("key %u lost\n", key);
+		return -1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	static struct test_ctx	ctx;
+	uint32_t				i;
+
+	alarm(10);
+	ctx.ht = hash_NewEx(TEST_TAB_LEN, HASH_ENGINE_OPEN);
+	if(!ctx.ht) return 1;
+	for(i = 0; i < TEST_BEFORE; i++)
+	{
+		if(hash_SetDataU32(ctx.ht, i, &i, sizeof(i)) < 0)
+			return 1;
+	}
+	if(hash_Iteration(ctx.ht, test_insert, &ctx))
+		return 1;
+	printf("inserted %u of %u keys during iteration\n", ctx.ok_num, TEST_IN_ITER);
+
+	/* 迭代结束,之后的操作会继续之前暂停的rehash */
+	for(i = 0; i < TEST_BEFORE; i++)
+	{
+		if(test_check(ctx.ht, i)) return 1;
+	}
+	for(i = 0; i < ctx.ok_num; i++)
+	{
+		if(test_check(ctx.ht, ctx.ok[i])) return 1;
+	}
+	for(i = TEST_BEFORE + TEST_IN_ITER; i < TEST_BEFORE + TEST_IN_ITER + TEST_AFTER; i++)
+	{
+		if(hash_SetDataU32(ctx.ht, i, &i, sizeof(i)) < 0){
+			printf("insert %u failed after iteration\n", i);
+			return 1;
+		}
+	}
+	for(i = TEST_BEFORE + TEST_IN_ITER; i < TEST_BEFORE + TEST_IN_ITER + TEST_AFTER; i++)
+	{
+		if(test_check(ctx.ht, i)) return 1;
+	}
+	hash_Del(ctx.ht);
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,168 @@
+/**
+ * @file hash_kv_parallel_bench.c
+ * @brief hash_kv 并行批量写入与并行遍历随线程数的伸缩性
+ * 		基线为单线程逐个 hash_SetData 与 hash_Iteration,
+ * 		之后线程数从1开始翻倍,测量 hash_ParallelSet 与 hash_ParallelForEach 的速度
+ * 		加速比以基线为1,结果取决于机器的核数,单核机器上不会有加速
+ *
+ * 编译(在仓库根目录):
+ * 	gcc -O2 -Igeneral/inc -Ilinux/inc linux/bench/hash_kv_parallel_bench.c \
+ * 		general/hash_kv.c general/crc_check.c general/pfifo.c -lpthread -o hash_kv_parallel_bench
+ * 运行:
+ * 	./hash_kv_parallel_bench [键数量=1000000] [最大线程数=8] [分片数=16]
+ * @author simon.xiaoapeng (simon.xiaoapeng@gmail.com)
+ * @version 1.0
+ * @date 2023-04-01
+ *
+ * @copyright Copyright (c) 2023  simon.xiaoapeng@gmail.com
+ *
+ * @par 修改日志:
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include "typedef.h"
+#include "hash_kv.h"
+
+#define BENCH_KEY_LEN		16
+#define BENCH_THREADS_MAX	64
+
+static uint64_t bench_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t			bench_sum[BENCH_THREADS_MAX];	/* 每个工作线程各自累加,避免共享计数 */
+static pthread_mutex_t	bench_mutex[BENCH_THREADS_MAX];
+
+static int bench_shard_lock(uint32_t shard)
+{
+	return pthread_mutex_lock(&bench_mutex[shard]);
+}
+
+static void bench_shard_unlock(uint32_t shard)
+{
+	pthread_mutex_unlock(&bench_mutex[shard]);
+}
+
+static enum HashIterState bench_iter(void *param,HashBlob_t *b)
+{
+	uint32_t	v = 0;
+	(void)param;
+	hash_BlobGetData(b, &v, sizeof(v));
+	bench_sum[0] += v;
+	return ITER_KEEP;
+}
+
+static enum HashIterState bench_foreach(void *param,uint32_t worker,const void *k,uint32_t k_len,
+				const void *data,uint32_t data_len)
+{
+	uint32_t	v;
+	(void)param;
+	(void)k;
+	(void)k_len;
+	if(data_len == sizeof(v)){
+		memcpy(&v, data, sizeof(v));
+		bench_sum[worker] += v;
+	}
+	return ITER_KEEP;
+}
+
+static HashKv_t bench_new(uint32_t n,uint32_t shards)
+{
+	HashKv_t	ht = hash_NewSharded(n / shards, HASH_ENGINE_CHAIN, shards);
+	if(ht)
+		hash_SetShardLock(ht, bench_shard_lock, bench_shard_unlock);
+	return ht;
+}
+
+static uint64_t bench_total(void)
+{
+	uint64_t	sum = 0;
+	uint32_t	i;
+	for(i = 0; i < BENCH_THREADS_MAX; i++)
+		sum += bench_sum[i];
+	memset(bench_sum, 0, sizeof(bench_sum));
+	return sum;
+}
+
+int main(int argc,char *argv[])
+{
+	uint32_t	n = argc > 1 ? (uint32_t)atoi(argv[1]) : 1000000;
+	uint32_t	max = argc > 2 ? (uint32_t)atoi(argv[2]) : 8;
+	uint32_t	shards = argc > 3 ? (uint32_t)atoi(argv[3]) : 16;
+	const char	**k;
+	const void	**data;
+	uint32_t	*data_len,*val;
+	char		*key_buf;
+	uint64_t	start,expect = 0;
+	double		set_base,iter_base,set_s,iter_s;
+	HashKv_t	ht;
+	uint32_t	i,t;
+
+	if(n == 0 || max == 0 || max > BENCH_THREADS_MAX || shards == 0 || shards > BENCH_THREADS_MAX){
+		printf("usage: %s [keys] [threads<=%d] [shards<=%d]\n", argv[0], BENCH_THREADS_MAX, BENCH_THREADS_MAX);
+		return 1;
+	}
+	for(i = 0; i < BENCH_THREADS_MAX; i++)
+		pthread_mutex_init(&bench_mutex[i], NULL);
+	k = malloc(n * sizeof(*k));
+	data = malloc(n * sizeof(*data));
+	data_len = malloc(n * sizeof(*data_len));
+	val = malloc(n * sizeof(*val));
+	key_buf = malloc((size_t)n * BENCH_KEY_LEN);
+	if(!k || !data || !data_len || !val || !key_buf) return 1;
+	for(i = 0; i < n; i++)
+	{
+		snprintf(key_buf + (size_t)i * BENCH_KEY_LEN, BENCH_KEY_LEN, "key/%u", i);
+		k[i] = key_buf + (size_t)i * BENCH_KEY_LEN;
+		val[i] = i;
+		data[i] = &val[i];
+		data_len[i] = sizeof(val[i]);
+		expect += i;
+	}
+
+	/* 基线: 单线程 */
+	ht = bench_new(n, shards);
+	start = bench_ns();
+	for(i = 0; i < n; i++)
+		hash_SetData(ht, k[i], data[i], data_len[i]);
+	set_base = (bench_ns() - start) / 1e9;
+	start = bench_ns();
+	hash_Iteration(ht, bench_iter, NULL);
+	iter_base = (bench_ns() - start) / 1e9;
+	if(bench_total() != expect)
+		printf("hash_Iteration sum mismatch\n");
+	hash_Del(ht);
+	printf("%-8s %14s %8s %14s %8s\n", "threads", "set keys/s", "speedup", "iter keys/s", "speedup");
+	printf("%-8s %14.0f %8.2f %14.0f %8.2f\n", "serial", n / set_base, 1.0, n / iter_base, 1.0);
+
+	for(t = 1; t <= max; t *= 2)
+	{
+		ht = bench_new(n, shards);
+		start = bench_ns();
+		if(hash_ParallelSet(ht, t, n, k, data, data_len, NULL) != (int)n)
+			printf("hash_ParallelSet failed\n");
+		set_s = (bench_ns() - start) / 1e9;
+		start = bench_ns();
+		hash_ParallelForEach(ht, t, bench_foreach, NULL);
+		iter_s = (bench_ns() - start) / 1e9;
+		if(bench_total() != expect)
+			printf("hash_ParallelForEach sum mismatch\n");
+		hash_Del(ht);
+		printf("%-8u %14.0f %8.2f %14.0f %8.2f\n", t, n / set_s, set_base / set_s,
+				n / iter_s, iter_base / iter_s);
+	}
+	free(k);
+	free(data);
+	free(data_len);
+	free(val);
+	free(key_buf);
+	return 0;
+}
@@ -0,0 +1,128 @@
+/**
+ * @file hash_kv_policy_bench.c
+ * @brief hash_kv 各哈希算法的质量与吞吐量对比
+ * 		对每个 enum HashPolicy 输出:
+ * 		ns/key(16B)、ns/key(64B)	用 hash_KeyHashBin 计算短键与长键哈希值的耗时
+ * 		chi2				哈希值低位落入 BENCH_BUCKETS 个桶的卡方值/桶数,均匀分布时约为1
+ * 		set+get/s			在 hash_New 表中写入再读出全部键的速度
+ * 		键为前缀相同、只有结尾序号不同的字符串,这是最容易暴露分布问题的一类
+ *
+ * 编译(在仓库根目录):
+ * 	gcc -O2 -Igeneral/inc -Ilinux/inc linux/bench/hash_kv_policy_bench.c \
+ * 		general/hash_kv.c general/crc_check.c general/pfifo.c -lpthread -o hash_kv_policy_bench
+ * 运行:
+ * 	./hash_kv_policy_bench [键数量=200000]
+ * @author simon.xiaoapeng (simon.xiaoapeng@gmail.com)
+ * @version 1.0
+ * @date 2023-04-01
+ *
+ * @copyright Copyright (c) 2023  simon.xiaoapeng@gmail.com
+ *
+ * @par 修改日志:
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include "typedef.h"
+#include "hash_kv.h"
+
+#define BENCH_BUCKETS		4096	/* 统计分布用的桶数量,必须为2的幂 */
+#define BENCH_LONG_KEY		64
+
+static uint64_t bench_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static const char *bench_policy_name[] = {
+	"RS", "JS", "PJW", "ELF", "BKDR", "SDBM", "DJB", "DEK", "BP", "FNV", "AP", "WY",
+};
+
+/* 防止计算哈希值的循环被整体优化掉 */
+static volatile uint32_t bench_sink;
+
+static double bench_hash_ns(HashKv_t ht,char *keys,uint32_t key_size,uint32_t key_len,uint32_t n)
+{
+	uint64_t	start;
+	uint32_t	i,sum = 0;
+
+	start = bench_ns();
+	for(i = 0; i < n; i++)
+		sum += hash_KeyHashBin(ht, keys + (size_t)i * key_size, key_len);
+	bench_sink = sum;
+	return (double)(bench_ns() - start) / n;
+}
+
+static double bench_chi2(HashKv_t ht,char *keys,uint32_t key_size,uint32_t key_len,uint32_t n)
+{
+	static uint32_t	cnt[BENCH_BUCKETS];
+	double		expect = (double)n / BENCH_BUCKETS;
+	double		chi2 = 0;
+	uint32_t	i;
+
+	memset(cnt, 0, sizeof(cnt));
+	for(i = 0; i < n; i++)
+		cnt[hash_KeyHashBin(ht, keys + (size_t)i * key_size, key_len) & (BENCH_BUCKETS - 1)]++;
+	for(i = 0; i < BENCH_BUCKETS; i++)
+		chi2 += (cnt[i] - expect) * (cnt[i] - expect) / expect;
+	return chi2 / BENCH_BUCKETS;
+}
+
+static double bench_table_ops(enum HashPolicy policy,char *keys,uint32_t key_size,uint32_t n)
+{
+	HashKv_t	ht = hash_New(n);
+	uint64_t	start;
+	uint32_t	i,v = 0;
+
+	hash_SetHashPolicy(ht, policy);
+	start = bench_ns();
+	for(i = 0; i < n; i++)
+		hash_SetData(ht, keys + (size_t)i * key_size, &i, sizeof(i));
+	for(i = 0; i < n; i++)
+		hash_GetData(ht, keys + (size_t)i * key_size, &v, sizeof(v));
+	start = bench_ns() - start;
+	bench_sink = v;
+	hash_Del(ht);
+	return n * 2 * 1e9 / start;
+}
+
+int main(int argc,char *argv[])
+{
+	uint32_t	n = argc > 1 ? (uint32_t)atoi(argv[1]) : 200000;
+	char		*short_keys,*long_keys;
+	HashKv_t	ht;
+	uint32_t	i;
+	int			p;
+
+	if(n == 0) return 1;
+	short_keys = malloc((size_t)n * 16);
+	long_keys = malloc((size_t)n * BENCH_LONG_KEY);
+	if(!short_keys || !long_keys) return 1;
+	for(i = 0; i < n; i++)
+	{
+		snprintf(short_keys + (size_t)i * 16, 16, "user:%010u", i);
+		memset(long_keys + (size_t)i * BENCH_LONG_KEY, 'p', BENCH_LONG_KEY);
+		snprintf(long_keys + (size_t)i * BENCH_LONG_KEY + BENCH_LONG_KEY - 16, 16, "user:%010u", i);
+	}
+
+	printf("%-6s %14s %14s %8s %14s\n", "policy", "ns/key(16B)", "ns/key(64B)", "chi2", "set+get/s");
+	for(p = HASH_POLICY_RS; p <= HASH_POLICY_WY; p++)
+	{
+		ht = hash_New(8);
+		hash_SetHashPolicy(ht, (enum HashPolicy)p);
+		printf("%-6s %14.2f %14.2f %8.2f %14.0f\n", bench_policy_name[p],
+				bench_hash_ns(ht, short_keys, 16, 15, n),
+				bench_hash_ns(ht, long_keys, BENCH_LONG_KEY, BENCH_LONG_KEY - 1, n),
+				bench_chi2(ht, short_keys, 16, 15, n),
+				bench_table_ops((enum HashPolicy)p, short_keys, 16, n));
+		hash_Del(ht);
+	}
+	free(short_keys);
+	free(long_keys);
+	return 0;
+}
@@ -0,0 +1,161 @@
+/**
+ * @file hash_kv_rcu_bench.c
+ * @brief hash_kv 读多写少模式的读吞吐量随读线程数的伸缩性
+ * 		读线程数从1逐个增加到上限,每轮N个读线程反复 hash_GetData,
+ * 		同时一个写线程不停覆盖已有的键,分别测量普通加锁模式与
+ * 		hash_SetReadMostly 之后的每秒读写次数,每个读线程数输出一行
+ *
+ * 编译(在仓库根目录):
+ * 	gcc -O2 -Igeneral/inc -Ilinux/inc linux/bench/hash_kv_rcu_bench.c \
+ * 		general/hash_kv.c general/crc_check.c general/pfifo.c -lpthread -o hash_kv_rcu_bench
+ * 运行:
+ * 	./hash_kv_rcu_bench [最大读线程数=8] [每轮毫秒数=500]
+ * @author simon.xiaoapeng (simon.xiaoapeng@gmail.com)
+ * @version 1.0
+ * @date 2023-04-01
+ *
+ * @copyright Copyright (c) 2023  simon.xiaoapeng@gmail.com
+ *
+ * @par 修改日志:
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "typedef.h"
+#include "hash_kv.h"
+
+#define BENCH_KEYS			4096
+#define BENCH_VAL_LEN		32
+#define BENCH_READERS_MAX	64
+
+static uint64_t bench_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static pthread_mutex_t	bench_mutex;
+static HashKv_t			bench_ht;
+static volatile int		bench_stop;
+static char				bench_key[BENCH_KEYS][16];
+
+static int bench_lock(void)
+{
+	return pthread_mutex_lock(&bench_mutex);
+}
+
+static void bench_unlock(void)
+{
+	pthread_mutex_unlock(&bench_mutex);
+}
+
+static void* bench_reader(void *arg)
+{
+	uint64_t	*ops = arg;
+	uint64_t	n = 0;
+	uint32_t	i = 0;
+	char		buf[BENCH_VAL_LEN];
+
+	while(!bench_stop)
+	{
+		hash_GetData(bench_ht, bench_key[i], buf, sizeof(buf));
+		i = (i + 1) % BENCH_KEYS;
+		n++;
+	}
+	*ops = n;
+	return NULL;
+}
+
+static void* bench_writer(void *arg)
+{
+	uint64_t	*ops = arg;
+	uint64_t	n = 0;
+	uint32_t	i = 0;
+	char		val[BENCH_VAL_LEN];
+
+	while(!bench_stop)
+	{
+		memset(val, (int)n, sizeof(val));
+		hash_SetData(bench_ht, bench_key[i], val, sizeof(val));
+		i = (i + 7) % BENCH_KEYS;
+		n++;
+	}
+	*ops = n;
+	return NULL;
+}
+
+/* 跑一轮,返回每秒读次数,*writes 返回每秒写次数 */
+static double bench_run(int read_mostly,int readers,uint32_t ms,double *writes)
+{
+	pthread_t	tid[BENCH_READERS_MAX + 1];
+	uint64_t	ops[BENCH_READERS_MAX + 1];
+	uint64_t	start,reads = 0;
+	double		ret;
+	char		val[BENCH_VAL_LEN] = {0};
+	int			i;
+
+	bench_ht = hash_New(BENCH_KEYS * 2);
+	hash_SetLock(bench_ht, bench_lock, bench_unlock);
+	if(read_mostly && hash_SetReadMostly(bench_ht)){
+		hash_Del(bench_ht);
+		*writes = 0;
+		return 0;
+	}
+	for(i = 0; i < BENCH_KEYS; i++)
+		hash_SetData(bench_ht, bench_key[i], val, sizeof(val));
+
+	bench_stop = 0;
+	start = bench_ns();
+	for(i = 0; i < readers; i++)
+		pthread_create(&tid[i], NULL, bench_reader, &ops[i]);
+	pthread_create(&tid[readers], NULL, bench_writer, &ops[readers]);
+	usleep(ms * 1000);
+	bench_stop = 1;
+	for(i = 0; i <= readers; i++)
+		pthread_join(tid[i], NULL);
+	start = bench_ns() - start;
+
+	for(i = 0; i < readers; i++)
+		reads += ops[i];
+	ret = reads * 1e9 / start;
+	*writes = ops[readers] * 1e9 / start;
+	hash_Del(bench_ht);
+	return ret;
+}
+
+int main(int argc,char *argv[])
+{
+	pthread_mutexattr_t attr;
+	int			max = argc > 1 ? atoi(argv[1]) : 8;
+	uint32_t	ms = argc > 2 ? (uint32_t)atoi(argv[2]) : 500;
+	double		lock_r,lock_w,rcu_r,rcu_w;
+	int			i,readers;
+
+	if(max < 1 || max > BENCH_READERS_MAX){
+		printf("readers must be 1..%d\n", BENCH_READERS_MAX);
+		return 1;
+	}
+	/* hash_SetLock 要求递归锁 */
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&bench_mutex, &attr);
+	for(i = 0; i < BENCH_KEYS; i++)
+		snprintf(bench_key[i], sizeof(bench_key[i]), "key/%d", i);
+
+	printf("%-8s %14s %12s %14s %12s %8s\n", "readers", "locked r/s", "locked w/s",
+			"rmostly r/s", "rmostly w/s", "speedup");
+	for(readers = 1; readers <= max; readers++)
+	{
+		lock_r = bench_run(0, readers, ms, &lock_w);
+		rcu_r = bench_run(1, readers, ms, &rcu_w);
+		printf("%-8d %14.0f %12.0f %14.0f %12.0f %8.2f\n", readers,
+				lock_r, lock_w, rcu_r, rcu_w, lock_r ? rcu_r / lock_r : 0);
+	}
+	return 0;
+}
@@ -0,0 +1,190 @@
+/**
+ * @file pfifo_mpmc_bench.c
+ * @brief MPMC pfifo 在多生产者/多消费者争用下的吞吐量与延迟
+ * 		对每组 生产者数x消费者数,分别测量:
+ * 		mpmc		无锁的 pfifo_mpmc_put/pfifo_mpmc_get
+ * 		mutex		一把互斥锁保护的普通 pfifo_put/pfifo_get,作为对比基线
+ * 		每个生产者放入固定数量的元素,全部取出后按总数/耗时计算吞吐量,并核对元素之和;
+ * 		每 BENCH_SAMPLE_EVERY 个元素在放入时打上时间戳,取出时记录放入到取出的延迟,
+ * 		输出这些样本的p50/p99
+ *
+ * 编译(在仓库根目录):
+ * 	gcc -O2 -Igeneral/inc linux/bench/pfifo_mpmc_bench.c general/pfifo.c -lpthread -o pfifo_mpmc_bench
+ * 运行:
+ * 	./pfifo_mpmc_bench [每个生产者的元素数=1000000] [最大线程数=4]
+ * @author simon.xiaoapeng (simon.xiaoapeng@gmail.com)
+ * @version 1.0
+ * @date 2023-11-22
+ *
+ * @copyright GPL 3.0
+ *
+ * @par 修改日志:
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include "pfifo.h"
+
+#define BENCH_FIFO_SIZE		1024
+#define BENCH_THREADS_MAX	32
+#define BENCH_SAMPLE_EVERY	64		/* 每隔多少个元素采样一次延迟,必须为2的幂 */
+
+struct bench_item {
+	uint64_t	id;			/* 从1开始的全局编号,用来核对元素之和 */
+	uint64_t	ts;			/* 放入时刻,只有采样的元素才有 */
+};
+
+static DECLARE_PFIFO_MPMC_PTR(bench_mpmc, struct bench_item);
+static DECLARE_PFIFO_PTR(bench_fifo, struct bench_item);
+static pthread_mutex_t	bench_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t			bench_n;
+static int				bench_use_mutex;
+static atomic_ullong	bench_sum;
+static atomic_ullong	bench_got;
+static uint64_t			*bench_lat;			/* 延迟样本,单位纳秒 */
+static atomic_uint		bench_lat_num;
+
+static uint64_t bench_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bench_put(const struct bench_item *v)
+{
+	int		ret;
+	if(!bench_use_mutex)
+		return pfifo_mpmc_put(&bench_mpmc, *v);
+	pthread_mutex_lock(&bench_mutex);
+	ret = pfifo_put(&bench_fifo, *v);
+	pthread_mutex_unlock(&bench_mutex);
+	return ret;
+}
+
+static int bench_get(struct bench_item *v)
+{
+	int		ret;
+	if(!bench_use_mutex)
+		return pfifo_mpmc_get(&bench_mpmc, v);
+	pthread_mutex_lock(&bench_mutex);
+	ret = pfifo_get(&bench_fifo, v);
+	pthread_mutex_unlock(&bench_mutex);
+	return ret;
+}
+
+static void* bench_producer(void *arg)
+{
+	struct bench_item	v;
+	uint64_t			base = (uintptr_t)arg * bench_n;
+	uint64_t			i;
+
+	for(i = 0; i < bench_n; )
+	{
+		v.id = base + i + 1;
+		v.ts = (v.id & (BENCH_SAMPLE_EVERY - 1)) ? 0 : bench_ns();
+		if(bench_put(&v))
+			i++;
+		else
+			sched_yield();	/* 队列满,让出CPU给消费者 */
+	}
+	return NULL;
+}
+
+static void* bench_consumer(void *arg)
+{
+	struct bench_item	v;
+	uint64_t			total = (uintptr_t)arg;
+	uint64_t			sum = 0,got = 0;
+
+	while(atomic_load_explicit(&bench_got, memory_order_relaxed) < total)
+	{
+		if(bench_get(&v)){
+			sum += v.id;
+			if(v.ts)
+				bench_lat[atomic_fetch_add(&bench_lat_num, 1)] = bench_ns() - v.ts;
+			if(++got == 256){
+				atomic_fetch_add(&bench_got, got);
+				got = 0;
+			}
+		}else{
+			if(got){
+				atomic_fetch_add(&bench_got, got);
+				got = 0;
+			}
+			sched_yield();
+		}
+	}
+	atomic_fetch_add(&bench_got, got);
+	atomic_fetch_add(&bench_sum, sum);
+	return NULL;
+}
+
+static int bench_cmp(const void *a,const void *b)
+{
+	uint64_t	x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+static void bench_run(int use_mutex,unsigned int producers,unsigned int consumers)
+{
+	pthread_t	tid[2 * BENCH_THREADS_MAX];
+	uint64_t	total = bench_n * producers;
+	uint64_t	start;
+	unsigned int i,num;
+
+	bench_use_mutex = use_mutex;
+	atomic_store(&bench_sum, 0);
+	atomic_store(&bench_got, 0);
+	atomic_store(&bench_lat_num, 0);
+	start = bench_ns();
+	for(i = 0; i < producers; i++)
+		pthread_create(&tid[i], NULL, bench_producer, (void*)(uintptr_t)i);
+	for(i = 0; i < consumers; i++)
+		pthread_create(&tid[producers + i], NULL, bench_consumer, (void*)(uintptr_t)total);
+	for(i = 0; i < producers + consumers; i++)
+		pthread_join(tid[i], NULL);
+	start = bench_ns() - start;
+
+	num = atomic_load(&bench_lat_num);
+	qsort(bench_lat, num, sizeof(*bench_lat), bench_cmp);
+	printf("%-6s %3ux%-3u %14.0f %10llu %10llu %s\n", use_mutex ? "mutex" : "mpmc", producers, consumers,
+			total * 1e9 / start,
+			num ? (unsigned long long)bench_lat[num / 2] : 0ULL,
+			num ? (unsigned long long)bench_lat[(uint64_t)num * 99 / 100] : 0ULL,
+			atomic_load(&bench_sum) == total * (total + 1) / 2 ? "" : "SUM MISMATCH");
+}
+
+int main(int argc,char *argv[])
+{
+	unsigned int	max = argc > 2 ? (unsigned int)atoi(argv[2]) : 4;
+	unsigned int	p,c;
+
+	bench_n = argc > 1 ? (uint64_t)atoll(argv[1]) : 1000000;
+	if(bench_n == 0 || max == 0 || max > BENCH_THREADS_MAX){
+		printf("usage: %s [items per producer] [threads<=%d]\n", argv[0], BENCH_THREADS_MAX);
+		return 1;
+	}
+	bench_lat = malloc((bench_n * max / BENCH_SAMPLE_EVERY + 1) * sizeof(*bench_lat));
+	if(!bench_lat || pfifo_mpmc_alloc(&bench_mpmc, BENCH_FIFO_SIZE) ||
+		pfifo_alloc(&bench_fifo, BENCH_FIFO_SIZE))
+		return 1;
+
+	printf("%-6s %7s %14s %10s %10s\n", "queue", "PxC", "items/s", "p50(ns)", "p99(ns)");
+	for(p = 1; p <= max; p *= 2)
+	{
+		for(c = 1; c <= max; c *= 2)
+		{
+			bench_run(0, p, c);
+			bench_run(1, p, c);
+		}
+	}
+	pfifo_mpmc_free(&bench_mpmc);
+	pfifo_free(&bench_fifo);
+	free(bench_lat);
+	return 0;
+}
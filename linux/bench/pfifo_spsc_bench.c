@@ -0,0 +1,164 @@
+/**
+ * @file pfifo_spsc_bench.c
+ * @brief 单生产者/单消费者 pfifo 的吞吐量,用来比较 PFIFO_USE_SPSC_CACHE 的效果
+ * 		一个线程逐个 pfifo_put,另一个线程逐个 pfifo_get 并核对顺序,
+ * 		之后以 pfifo_in/pfifo_out 按块搬运字节再测一次
+ * 		生产者与消费者分别绑定到两个不同的CPU上,避免调度器把它们放到同一个核
+ * 		PFIFO_USE_SPSC_CACHE 默认关闭,分别编译两份对比:
+ *
+ * 编译(在仓库根目录):
+ * 	gcc -O2 -Igeneral/inc linux/bench/pfifo_spsc_bench.c general/pfifo.c -lpthread -o pfifo_spsc_bench
+ * 	gcc -O2 -DPFIFO_USE_SPSC_CACHE=1 -Igeneral/inc linux/bench/pfifo_spsc_bench.c general/pfifo.c \
+ * 		-lpthread -o pfifo_spsc_bench_cache
+ * 运行:
+ * 	./pfifo_spsc_bench [元素数=20000000] [生产者CPU=0] [消费者CPU=1]
+ * @author simon.xiaoapeng (simon.xiaoapeng@gmail.com)
+ * @version 1.0
+ * @date 2023-11-22
+ *
+ * @copyright GPL 3.0
+ *
+ * @par 修改日志:
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include "pfifo.h"
+
+#define BENCH_FIFO_SIZE		1024
+#define BENCH_CHUNK			64
+
+static DECLARE_PFIFO_PTR(bench_q, uint64_t);
+static struct pfifo bench_bytes;
+static uint64_t bench_n;
+
+static uint64_t bench_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void* bench_put_thread(void *arg)
+{
+	uint64_t	i;
+	(void)arg;
+	for(i = 1; i <= bench_n; )
+	{
+		if(pfifo_put(&bench_q, i))
+			i++;
+		else
+			sched_yield();	/* 队列满,让出CPU给消费者 */
+	}
+	return NULL;
+}
+
+static void* bench_in_thread(void *arg)
+{
+	unsigned char	buf[BENCH_CHUNK];
+	uint64_t		i,total = bench_n * sizeof(uint64_t);
+	unsigned int	j,n;
+	(void)arg;
+	for(i = 0; i < total; )
+	{
+		for(j = 0; j < BENCH_CHUNK; j++)
+			buf[j] = (unsigned char)(i + j);
+		n = pfifo_in(&bench_bytes, buf, BENCH_CHUNK);
+		if(n)
+			i += n;
+		else
+			sched_yield();
+	}
+	return NULL;
+}
+
+int main(int argc,char *argv[])
+{
+	unsigned char	buf[BENCH_CHUNK];
+	pthread_t		tid;
+	uint64_t		start,expect,v,i,total;
+	unsigned int	j,n;
+	pthread_attr_t	attr;
+	cpu_set_t		set;
+	int				prod_cpu,cons_cpu;
+
+	bench_n = argc > 1 ? (uint64_t)atoll(argv[1]) : 20000000;
+	prod_cpu = argc > 2 ? atoi(argv[2]) : 0;
+	cons_cpu = argc > 3 ? atoi(argv[3]) : 1;
+	if(bench_n == 0 || prod_cpu == cons_cpu || prod_cpu < 0 || cons_cpu < 0 ||
+		prod_cpu >= CPU_SETSIZE || cons_cpu >= CPU_SETSIZE){
+		printf("usage: %s [elements] [producer cpu] [consumer cpu], cpus must differ\n", argv[0]);
+		return 1;
+	}
+	if(pfifo_alloc(&bench_q, BENCH_FIFO_SIZE) ||
+		pfifo_alloc(&bench_bytes, BENCH_FIFO_SIZE * sizeof(uint64_t)))
+		return 1;
+	/* 主线程作为消费者,生产者线程创建时就绑定到自己的CPU */
+	CPU_ZERO(&set);
+	CPU_SET(cons_cpu, &set);
+	if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set)){
+		printf("cannot pin consumer to cpu %d\n", cons_cpu);
+		return 1;
+	}
+	CPU_ZERO(&set);
+	CPU_SET(prod_cpu, &set);
+	pthread_attr_init(&attr);
+	pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+	printf("PFIFO_USE_SPSC_CACHE=%d sizeof(struct __pfifo)=%zu producer cpu %d consumer cpu %d\n",
+			PFIFO_USE_SPSC_CACHE, sizeof(struct __pfifo), prod_cpu, cons_cpu);
+
+	start = bench_ns();
+	if(pthread_create(&tid, &attr, bench_put_thread, NULL)){
+		printf("cannot pin producer to cpu %d\n", prod_cpu);
+		return 1;
+	}
+	for(expect = 1; expect <= bench_n; )
+	{
+		if(!pfifo_get(&bench_q, &v)){
+			sched_yield();
+			continue;
+		}
+		if(v != expect){
+			printf("put/get order mismatch at %llu\n", (unsigned long long)expect);
+			return 1;
+		}
+		expect++;
+	}
+	pthread_join(tid, NULL);
+	start = bench_ns() - start;
+	printf("%-10s %14.0f elements/s\n", "put/get", bench_n * 1e9 / start);
+
+	total = bench_n * sizeof(uint64_t);
+	start = bench_ns();
+	if(pthread_create(&tid, &attr, bench_in_thread, NULL))
+		return 1;
+	for(i = 0; i < total; )
+	{
+		n = pfifo_out(&bench_bytes, buf, BENCH_CHUNK);
+		if(!n){
+			sched_yield();
+			continue;
+		}
+		for(j = 0; j < n; j++)
+		{
+			if(buf[j] != (unsigned char)(i + j)){
+				printf("in/out data mismatch at %llu\n", (unsigned long long)(i + j));
+				return 1;
+			}
+		}
+		i += n;
+	}
+	pthread_join(tid, NULL);
+	start = bench_ns() - start;
+	printf("%-10s %14.0f bytes/s\n", "in/out", total * 1e9 / start);
+
+	pthread_attr_destroy(&attr);
+	pfifo_free(&bench_q);
+	pfifo_free(&bench_bytes);
+	return 0;
+}
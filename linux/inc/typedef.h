@@ -36,8 +36,8 @@ static inline uint32_t get_milliseconds() {
     return milliseconds;
 }
 
-#define MALLOC(__size) 
-#define FREE(__ptr)
+#define MALLOC(__size) malloc(__size)
+#define FREE(__ptr)    free(__ptr)
 #define DELAY(__ms)
 #define DELAY_US(__us)
 #define GET_TICK()	   get_milliseconds()